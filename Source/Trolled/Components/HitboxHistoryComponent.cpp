@@ -0,0 +1,258 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "HitboxHistoryComponent.h"
+#include "GameFramework/Character.h"
+#include "Components/SkeletalMeshComponent.h"
+
+// Sets default values for this component's properties
+UHitboxHistoryComponent::UHitboxHistoryComponent()
+{
+	// record after physics so the bones match what was sent to clients this frame
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.TickGroup = TG_PostPhysics;
+
+	// half a second covers players up to around 250ms ping plus interpolation delay
+	MaxRewindTime = 0.5f;
+	RecordRate = 30.f;
+	BoneLeeway = 15.f;
+
+	// default hitboxes for the mannequin skeleton
+	HitboxBones.Add(FHitboxBone(FName("head"), 15.f));
+	HitboxBones.Add(FHitboxBone(FName("neck_01"), 10.f));
+	HitboxBones.Add(FHitboxBone(FName("spine_03"), 22.f));
+	HitboxBones.Add(FHitboxBone(FName("spine_01"), 22.f));
+	HitboxBones.Add(FHitboxBone(FName("pelvis"), 20.f));
+	HitboxBones.Add(FHitboxBone(FName("upperarm_l"), 10.f));
+	HitboxBones.Add(FHitboxBone(FName("upperarm_r"), 10.f));
+	HitboxBones.Add(FHitboxBone(FName("lowerarm_l"), 8.f));
+	HitboxBones.Add(FHitboxBone(FName("lowerarm_r"), 8.f));
+	HitboxBones.Add(FHitboxBone(FName("thigh_l"), 12.f));
+	HitboxBones.Add(FHitboxBone(FName("thigh_r"), 12.f));
+	HitboxBones.Add(FHitboxBone(FName("calf_l"), 10.f));
+	HitboxBones.Add(FHitboxBone(FName("calf_r"), 10.f));
+
+	TrackedMesh = nullptr;
+	OldestSlot = 0;
+	NumFrames = 0;
+	LastRecordTime = -1.f;
+}
+
+void UHitboxHistoryComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	// only the server validates hits, clients never need the history
+	if (!GetOwner() || !GetOwner()->HasAuthority())
+	{
+		SetComponentTickEnabled(false);
+		return;
+	}
+
+	if (ACharacter* Character = Cast<ACharacter>(GetOwner()))
+	{
+		TrackedMesh = Character->GetMesh();
+	}
+
+	// resolve the bone names once so recording is just an index lookup
+	TrackedBoneIndices.Reset(HitboxBones.Num());
+	for (const FHitboxBone& HitboxBone : HitboxBones)
+	{
+		TrackedBoneIndices.Add(TrackedMesh ? TrackedMesh->GetBoneIndex(HitboxBone.BoneName) : INDEX_NONE);
+	}
+
+	// allocate the ring buffer up front, one extra frame so MaxRewindTime is always covered
+	const int32 Capacity = FMath::CeilToInt(MaxRewindTime * RecordRate) + 1;
+	FrameTimes.SetNumZeroed(Capacity);
+	FrameBounds.SetNumZeroed(Capacity);
+	FrameBoneLocations.SetNumZeroed(Capacity * TrackedBoneIndices.Num());
+
+	ResetHistory();
+}
+
+void UHitboxHistoryComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	// only record at the record rate
+	if (TrackedMesh && GetWorld()->TimeSince(LastRecordTime) >= 1.f / RecordRate)
+	{
+		RecordFrame();
+	}
+}
+
+void UHitboxHistoryComponent::RecordFrame()
+{
+	const int32 Capacity = FrameTimes.Num();
+	if (Capacity == 0)
+	{
+		return;
+	}
+
+	// if the buffer is full, overwrite the oldest frame
+	int32 Slot;
+	if (NumFrames < Capacity)
+	{
+		Slot = GetSlot(NumFrames);
+		++NumFrames;
+	}
+	else
+	{
+		Slot = OldestSlot;
+		OldestSlot = (OldestSlot + 1) % Capacity;
+	}
+
+	LastRecordTime = GetWorld()->GetTimeSeconds();
+
+	FrameTimes[Slot] = LastRecordTime;
+	FrameBounds[Slot] = TrackedMesh->Bounds.GetBox();
+
+	// store the world location of each bone
+	const int32 NumBones = TrackedBoneIndices.Num();
+	for (int32 i = 0; i < NumBones; ++i)
+	{
+		const int32 BoneIndex = TrackedBoneIndices[i];
+		FrameBoneLocations[Slot * NumBones + i] = BoneIndex != INDEX_NONE ? TrackedMesh->GetBoneTransform(BoneIndex).GetLocation() : TrackedMesh->GetComponentLocation();
+	}
+}
+
+void UHitboxHistoryComponent::ResetHistory()
+{
+	OldestSlot = 0;
+	NumFrames = 0;
+	LastRecordTime = -1.f;
+
+	// start with a frame of the current pose so hits straight after a reset still have something to check against
+	if (TrackedMesh)
+	{
+		RecordFrame();
+	}
+}
+
+void UHitboxHistoryComponent::FillHistory()
+{
+	const int32 Capacity = FrameTimes.Num();
+	if (!TrackedMesh || Capacity == 0)
+	{
+		return;
+	}
+
+	OldestSlot = 0;
+	NumFrames = 0;
+
+	// record a frame into every slot, then backdate them so the history covers the full rewind window
+	const float Now = GetWorld()->GetTimeSeconds();
+	for (int32 i = Capacity - 1; i >= 0; --i)
+	{
+		RecordFrame();
+		FrameTimes[GetSlot(NumFrames - 1)] = Now - i / RecordRate;
+	}
+
+	LastRecordTime = Now;
+}
+
+bool UHitboxHistoryComponent::FindFrames(const float Time, int32& OutOlder, int32& OutNewer, float& OutAlpha) const
+{
+	if (NumFrames == 0)
+	{
+		return false;
+	}
+
+	// anything older than the history uses the oldest frame, anything newer uses the newest
+	const int32 Oldest = GetSlot(0);
+	const int32 Newest = GetSlot(NumFrames - 1);
+	if (Time <= FrameTimes[Oldest])
+	{
+		OutOlder = OutNewer = Oldest;
+		OutAlpha = 0.f;
+		return true;
+	}
+
+	if (Time >= FrameTimes[Newest])
+	{
+		OutOlder = OutNewer = Newest;
+		OutAlpha = 0.f;
+		return true;
+	}
+
+	// frames are in time order, so walk back from the newest until we pass the time
+	for (int32 i = NumFrames - 2; i >= 0; --i)
+	{
+		const int32 Slot = GetSlot(i);
+		if (FrameTimes[Slot] <= Time)
+		{
+			OutOlder = Slot;
+			OutNewer = GetSlot(i + 1);
+
+			const float FrameDelta = FrameTimes[OutNewer] - FrameTimes[OutOlder];
+			OutAlpha = FrameDelta > KINDA_SMALL_NUMBER ? (Time - FrameTimes[OutOlder]) / FrameDelta : 0.f;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool UHitboxHistoryComponent::GetBoundsAtTime(const float Time, FBox& OutBounds) const
+{
+	int32 Older, Newer;
+	float Alpha;
+	if (!FindFrames(Time, Older, Newer, Alpha))
+	{
+		return false;
+	}
+
+	// lerp the min and max of the two frames
+	const FBox& OlderBounds = FrameBounds[Older];
+	const FBox& NewerBounds = FrameBounds[Newer];
+	OutBounds = FBox(FMath::Lerp(OlderBounds.Min, NewerBounds.Min, Alpha), FMath::Lerp(OlderBounds.Max, NewerBounds.Max, Alpha));
+	return true;
+}
+
+bool UHitboxHistoryComponent::WasNearLocation(const float Time, const FVector& Location, const float Leeway) const
+{
+	FBox Bounds;
+	if (!GetBoundsAtTime(Time, Bounds))
+	{
+		// no history to compare against, dont punish the shooter for it
+		return true;
+	}
+
+	return Bounds.ExpandBy(Leeway).IsInside(Location);
+}
+
+bool UHitboxHistoryComponent::ValidateHit(const float ShotTime, const FVector& Origin, const FVector& Direction, const float Range, const FName BoneName, const float Leeway) const
+{
+	int32 Older, Newer;
+	float Alpha;
+	if (!FindFrames(ShotTime, Older, Newer, Alpha))
+	{
+		// nothing has been recorded yet, so there is nothing to check against
+		return true;
+	}
+
+	const FVector TraceEnd = Origin + Direction * Range;
+
+	// cheap reject, the ray has to pass through the rewound bounds
+	const FBox Bounds = FBox(FMath::Lerp(FrameBounds[Older].Min, FrameBounds[Newer].Min, Alpha), FMath::Lerp(FrameBounds[Older].Max, FrameBounds[Newer].Max, Alpha)).ExpandBy(Leeway);
+	if (!FMath::LineBoxIntersection(Bounds, Origin, TraceEnd, TraceEnd - Origin))
+	{
+		return false;
+	}
+
+	// if the claimed bone is recorded, the ray has to pass close enough to it
+	if (BoneName != NAME_None)
+	{
+		const int32 NumBones = TrackedBoneIndices.Num();
+		for (int32 i = 0; i < NumBones; ++i)
+		{
+			if (HitboxBones[i].BoneName == BoneName)
+			{
+				const FVector BoneLocation = FMath::Lerp(FrameBoneLocations[Older * NumBones + i], FrameBoneLocations[Newer * NumBones + i], Alpha);
+				return FMath::PointDistToSegment(BoneLocation, Origin, TraceEnd) <= HitboxBones[i].Radius + BoneLeeway;
+			}
+		}
+	}
+
+	// bones that aren't recorded are covered by the bounds check
+	return true;
+}
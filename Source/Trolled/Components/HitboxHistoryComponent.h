@@ -0,0 +1,119 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "HitboxHistoryComponent.generated.h"
+
+// a bone that is recorded for lag compensation, the radius is the rough size of the hitbox around the bone
+USTRUCT(BlueprintType)
+struct FHitboxBone
+{
+	GENERATED_BODY()
+
+	FHitboxBone()
+	{
+		BoneName = NAME_None;
+		Radius = 10.f;
+	}
+
+	FHitboxBone(const FName InBoneName, const float InRadius) : BoneName(InBoneName), Radius(InRadius) {};
+
+	// bone on the characters mesh to record
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Hitbox")
+	FName BoneName;
+
+	// radius of the hitbox around the bone
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Hitbox", meta = (ClampMin = 0.0))
+	float Radius;
+};
+
+/**
+ * Server side history of a characters hitboxes, used to rewind the character to where the shooter saw it
+ * Frames are stored in a fixed size ring buffer so recording never allocates once the component has started
+ */
+UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
+class TROLLED_API UHitboxHistoryComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	// Sets default values for this component's properties
+	UHitboxHistoryComponent();
+
+	/** Check a shot against the hitboxes as they were at ShotTime. No physics trace is done, the ray is tested against the recorded bounds and bones
+	 * @param ShotTime server world time the shot was fired at
+	 * @param Origin where the shot started
+	 * @param Direction normalized direction of the shot
+	 * @param Range max distance of the shot
+	 * @param BoneName bone the shooter claimed to hit, NAME_None to only check the bounds
+	 * @param Leeway extra distance allowed around the bounds to make up for interpolation and quantization errors
+	 * @return true if the shot could have hit */
+	bool ValidateHit(const float ShotTime, const FVector& Origin, const FVector& Direction, const float Range, const FName BoneName, const float Leeway) const;
+
+	// check that a point was inside the characters bounds at the given time, used to check a shooters claimed origin
+	bool WasNearLocation(const float Time, const FVector& Location, const float Leeway) const;
+
+	// returns the bounds of the character at a given time, false if there is no history yet
+	bool GetBoundsAtTime(const float Time, FBox& OutBounds) const;
+
+	// clears all recorded frames, called when the character is teleported or respawned
+	void ResetHistory();
+
+	// fills every frame of the history with the current pose, spaced at the record rate back from now. Used by the hit validation benchmark
+	void FillHistory();
+
+	// how far back in seconds hits can be rewound. Shots older than this are checked against the oldest frame
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Hitbox", meta = (ClampMin = 0.05))
+	float MaxRewindTime;
+
+	// how many frames to record per second
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Hitbox", meta = (ClampMin = 1.0))
+	float RecordRate;
+
+	// extra distance allowed around a recorded bone on top of its radius
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Hitbox", meta = (ClampMin = 0.0))
+	float BoneLeeway;
+
+	// bones to record, hits on bones not in this list only check against the bounds
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Hitbox")
+	TArray<FHitboxBone> HitboxBones;
+
+protected:
+	// Called when the game starts
+	virtual void BeginPlay() override;
+
+	// records the current pose on the server
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+private:
+
+	// stores the current pose of the mesh into the next slot in the ring buffer
+	void RecordFrame();
+
+	// finds the two frames around a given time and the alpha between them
+	bool FindFrames(const float Time, int32& OutOlder, int32& OutNewer, float& OutAlpha) const;
+
+	// converts a ring index (0 is the oldest frame) to a slot in the buffer
+	FORCEINLINE int32 GetSlot(const int32 RingIndex) const { return (OldestSlot + RingIndex) % FrameTimes.Num(); }
+
+	// mesh bones resolved from HitboxBones at begin play
+	TArray<int32> TrackedBoneIndices;
+
+	// mesh that is being recorded
+	UPROPERTY()
+	class USkeletalMeshComponent* TrackedMesh;
+
+	// frame data stored as flat arrays, bone locations are NumTrackedBones per frame
+	TArray<float> FrameTimes;
+	TArray<FBox> FrameBounds;
+	TArray<FVector> FrameBoneLocations;
+
+	// ring buffer state
+	int32 OldestSlot;
+	int32 NumFrames;
+
+	// time of the last recorded frame
+	float LastRecordTime;
+};
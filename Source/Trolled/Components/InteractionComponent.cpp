@@ -2,8 +2,10 @@
 
 
 #include "InteractionComponent.h"
-#include "Trolled/Widgets/InteractionWidget.h"
 #include "Trolled/MainCharacter.h"
+#include "Trolled/Player/TrolledPlayerController.h"
+#include "Trolled/Components/InteractionSubsystem.h"
+#include "Components/ShapeComponent.h"
 
 UInteractionComponent::UInteractionComponent()
 {
@@ -25,14 +27,11 @@ UInteractionComponent::UInteractionComponent()
     // allow multiple interactors
     bAllowMultipleInteractors = true;
 
-    // Setup the UI for displaying interaction text in screen space
-    Space = EWidgetSpace::Screen;
-    DrawSize = FIntPoint(400, 100);
-    bDrawAtDesiredSize = true;
-
-    // enabled but hidden by default to prevent every interaction from displaying on spawn in
+    // enabled by default, the prompt is only shown by the local players controller while focused
     SetActive(true);
-    SetHiddenInGame(true);
+
+    FocusPrimitivesComponentCount = INDEX_NONE;
+    bFocusHighlighted = false;
 }
 
 void UInteractionComponent::SetInteractableNameText(const FText& NewNameText) 
@@ -49,11 +48,26 @@ void UInteractionComponent::SetInteractableActionText(const FText& NewActionText
     RefreshWidget();
 }
 
+void UInteractionComponent::Activate(bool bReset) 
+{
+    Super::Activate(bReset);
+
+    if (UInteractionSubsystem* Interactions = GetWorld() ? GetWorld()->GetSubsystem<UInteractionSubsystem>() : nullptr)
+    {
+        Interactions->NotifyInteractableChanged(this);
+    }
+}
+
 // find all interactors, if they are characters, stop focus and interact
 void UInteractionComponent::Deactivate() 
 {
     Super::Deactivate();
 
+    if (UInteractionSubsystem* Interactions = GetWorld() ? GetWorld()->GetSubsystem<UInteractionSubsystem>() : nullptr)
+    {
+        Interactions->NotifyInteractableChanged(this);
+    }
+
     for (int32 i = Interactors.Num() - 1; i >= 0; --i)
     {
         if(AMainCharacter* Interactor = Interactors[i])
@@ -67,6 +81,57 @@ void UInteractionComponent::Deactivate()
     Interactors.Empty();
 }
 
+void UInteractionComponent::OnRegister() 
+{
+    Super::OnRegister();
+
+    // only game worlds run interaction checks
+    UWorld* World = GetWorld();
+    if (World && World->IsGameWorld())
+    {
+        if (UInteractionSubsystem* Interactions = World->GetSubsystem<UInteractionSubsystem>())
+        {
+            Interactions->AddInteractable(this);
+            TransformUpdatedHandle = TransformUpdated.AddUObject(this, &UInteractionComponent::OnInteractableMoved);
+        }
+
+        // servers never outline anything
+        if (GetNetMode() != NM_DedicatedServer)
+        {
+            CacheFocusPrimitives();
+        }
+    }
+}
+
+void UInteractionComponent::OnUnregister() 
+{
+    if (TransformUpdatedHandle.IsValid())
+    {
+        TransformUpdated.Remove(TransformUpdatedHandle);
+        TransformUpdatedHandle.Reset();
+
+        if (UInteractionSubsystem* Interactions = GetWorld() ? GetWorld()->GetSubsystem<UInteractionSubsystem>() : nullptr)
+        {
+            Interactions->RemoveInteractable(this);
+        }
+    }
+
+    FocusPrimitives.Empty();
+    FocusPrimitivesComponentCount = INDEX_NONE;
+    bFocusHighlighted = false;
+
+    Super::OnUnregister();
+}
+
+void UInteractionComponent::OnInteractableMoved(USceneComponent* UpdatedComponent, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport) 
+{
+    // moves the component to a new cell only if it left its old one
+    if (UInteractionSubsystem* Interactions = GetWorld()->GetSubsystem<UInteractionSubsystem>())
+    {
+        Interactions->UpdateInteractable(this);
+    }
+}
+
 bool UInteractionComponent::CanInteract(class AMainCharacter* Character) const
 {
     // if multiple interactors is not allowed and the number of interactors is greater or equal to 1
@@ -78,13 +143,77 @@ bool UInteractionComponent::CanInteract(class AMainCharacter* Character) const
 
 void UInteractionComponent::RefreshWidget() 
 {
-    // if object not hidden and not the server
-    if (!bHiddenInGame && GetOwner()->GetNetMode() != NM_DedicatedServer)
+    // servers never show prompts
+    if (GetNetMode() == NM_DedicatedServer)
     {
-        // check for widget to exist, then update it
-        if (UInteractionWidget* InteractionWidget = Cast<UInteractionWidget>(GetUserWidgetObject()))
+        return;
+    }
+
+    // update the prompt of any local player focused on this, clients only have their own controllers in the list
+    for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; ++It)
+    {
+        ATrolledPlayerController* PC = Cast<ATrolledPlayerController>(It->Get());
+        if (PC && PC->IsLocalController())
         {
-            InteractionWidget->UpdateInteractionWidget(this);
+            PC->RefreshInteractionPrompt(this);
+        }
+    }
+}
+
+void UInteractionComponent::InvalidateFocusPrimitives() 
+{
+    FocusPrimitivesComponentCount = INDEX_NONE;
+}
+
+void UInteractionComponent::CacheFocusPrimitives() 
+{
+    FocusPrimitives.Reset();
+    FocusPrimitivesComponentCount = INDEX_NONE;
+
+    AActor* Owner = GetOwner();
+    if (!Owner)
+    {
+        return;
+    }
+
+    for (UActorComponent* Component : Owner->GetComponents())
+    {
+        // skip collision shapes, they never draw in game so outlining them only dirties their render state
+        UPrimitiveComponent* Prim = Cast<UPrimitiveComponent>(Component);
+        if (Prim && !Prim->IsA<UShapeComponent>())
+        {
+            FocusPrimitives.Add(Prim);
+        }
+    }
+
+    FocusPrimitivesComponentCount = Owner->GetComponents().Num();
+}
+
+void UInteractionComponent::SetFocusHighlight(const bool bHighlight) 
+{
+    if (!GetOwner())
+    {
+        return;
+    }
+
+    // rebuild the cache if components were added to or removed from the owner since it was built
+    if (FocusPrimitivesComponentCount != GetOwner()->GetComponents().Num())
+    {
+        CacheFocusPrimitives();
+    }
+    else if (bFocusHighlighted == bHighlight)
+    {
+        return;
+    }
+
+    bFocusHighlighted = bHighlight;
+
+    for (const TWeakObjectPtr<UPrimitiveComponent>& Prim : FocusPrimitives)
+    {
+        // SetRenderCustomDepth marks the render state dirty, so only call it on primitives that actually change
+        if (Prim.IsValid() && Prim->bRenderCustomDepth != bHighlight)
+        {
+            Prim->SetRenderCustomDepth(bHighlight);
         }
     }
 }
@@ -109,22 +238,16 @@ void UInteractionComponent::StartFocus(class AMainCharacter* Character)
     // found from original code files
     if (GetNetMode() != NM_DedicatedServer)
     {
-         // show UI
-        SetHiddenInGame(false);
-
-        // grab visual components, primitive
-        // updated for UE 4.25
-        for (auto& VisualComp : GetOwner()->GetComponents())
+        // show UI, only for the player doing the focusing
+        ATrolledPlayerController* PC = Cast<ATrolledPlayerController>(Character->GetController());
+        if (PC && PC->IsLocalController())
         {
-            // set outline around the object
-            if (UPrimitiveComponent* Prim = Cast<UPrimitiveComponent>(VisualComp))
-            {
-                Prim->SetRenderCustomDepth(true);
-            }
-        }  
-    }
+            PC->ShowInteractionPrompt(this);
+        }
 
-    RefreshWidget();
+        // set outline around the object
+        SetFocusHighlight(true);
+    }
 }
 
 void UInteractionComponent::StopFocus(class AMainCharacter* Character) 
@@ -136,18 +259,14 @@ void UInteractionComponent::StopFocus(class AMainCharacter* Character)
     if (GetNetMode() != NM_DedicatedServer)
     {
         // Hide UI
-        SetHiddenInGame(true);
-
-        // grab visual components, primitive
-        // updated for UE 4.25
-        for (auto& VisualComp : GetOwner()->GetComponents())
+        ATrolledPlayerController* PC = Character ? Cast<ATrolledPlayerController>(Character->GetController()) : nullptr;
+        if (PC && PC->IsLocalController())
         {
-            // set outline around the object
-            if (UPrimitiveComponent* Prim = Cast<UPrimitiveComponent>(VisualComp))
-            {
-                Prim->SetRenderCustomDepth(false);
-            }
-        }  
+            PC->HideInteractionPrompt(this);
+        }
+
+        // remove the outline around the object
+        SetFocusHighlight(false);
     }
 }
 
@@ -3,7 +3,7 @@
 #pragma once
 
 #include "CoreMinimal.h"
-#include "Components/WidgetComponent.h"
+#include "Components/SceneComponent.h"
 #include "InteractionComponent.generated.h"
 
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnBeginInteract, class AMainCharacter*, Character);
@@ -13,11 +13,12 @@ DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnStopFocus, class AMainCharacter*,
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnInteract, class AMainCharacter*, Character);
 
 /**
- * 
+ * Marks where and how an actor can be interacted with. The prompt for whichever interactable a local player is
+ * focused on is drawn by that players controller, so this component carries no widget of its own
  */
 // allows creating this component via blueprints
 UCLASS(ClassGroup = (Custom), meta = (BlueprintSpawnableComponent))
-class TROLLED_API UInteractionComponent : public UWidgetComponent
+class TROLLED_API UInteractionComponent : public USceneComponent
 {
 	GENERATED_BODY()
 
@@ -75,9 +76,37 @@ public:
 
 protected:
 	
+	// lets nearby players know to check for this interactable again
+	virtual void Activate(bool bReset = false) override;
+
 	// called at game start to clear all interactions
 	virtual void Deactivate() override;
 
+	// adds and removes the component from the interaction grid so players can find it without tracing
+	virtual void OnRegister() override;
+	virtual void OnUnregister() override;
+
+	// keeps the interaction grid up to date when the owner moves
+	void OnInteractableMoved(USceneComponent* UpdatedComponent, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport);
+
+	// handle for the TransformUpdated binding while the component is in the interaction grid
+	FDelegateHandle TransformUpdatedHandle;
+
+	// turns the outline around the owner on or off, only primitives that need to change are touched
+	void SetFocusHighlight(const bool bHighlight);
+
+	// gathers the owners visible primitives into FocusPrimitives
+	void CacheFocusPrimitives();
+
+	// primitives of the owner that are outlined on focus, cached so focus changes don't walk every component
+	TArray<TWeakObjectPtr<UPrimitiveComponent>> FocusPrimitives;
+
+	// number of components the owner had when FocusPrimitives was cached, the cache is rebuilt when this changes
+	int32 FocusPrimitivesComponentCount;
+
+	// whether the outline is currently on
+	bool bFocusHighlighted;
+
 	// check if a character can interact with a specific object
 	bool CanInteract(class AMainCharacter* Character) const;
 
@@ -87,10 +116,13 @@ protected:
 
 
 public:
-	// refreshes the interaction widget, used when changing stack size for an item, changing name or action text, etc.
+	// refreshes the interaction prompt if a local player is focused on this, used when changing stack size for an item, changing name or action text, etc.
 	void RefreshWidget();
 
-	// Called on the client when a player interaction check trace starts or stops hitting this item
+	// forces the outlined primitives to be gathered again on the next focus change, for owners that swap meshes without adding components
+	void InvalidateFocusPrimitives();
+
+	// Called on the client when a player interaction check starts or stops finding this item
 	void StartFocus(class AMainCharacter* Character);
 	void StopFocus(class AMainCharacter* Character);
 
@@ -0,0 +1,274 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "InteractionSubsystem.h"
+#include "Trolled/Trolled.h"
+#include "Trolled/Components/InteractionComponent.h"
+#include "Engine/World.h"
+
+DECLARE_CYCLE_STAT(TEXT("Interaction Check"), STAT_InteractionCheck, STATGROUP_TrolledInteraction);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Interaction Traces"), STAT_InteractionTraces, STATGROUP_TrolledInteraction);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Interaction Candidates"), STAT_InteractionCandidates, STATGROUP_TrolledInteraction);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Interaction Validation Traces"), STAT_InteractionValidationTraces, STATGROUP_TrolledInteraction);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Interaction Validations Over Budget"), STAT_InteractionValidationsOverBudget, STATGROUP_TrolledInteraction);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Registered Interactables"), STAT_InteractionRegistered, STATGROUP_TrolledInteraction);
+
+void UInteractionSubsystem::Deinitialize()
+{
+	Cells.Empty();
+	InteractableCells.Empty();
+	CellStamps.Empty();
+	Candidates.Empty();
+
+	Super::Deinitialize();
+}
+
+FIntVector UInteractionSubsystem::GetCell(const FVector& Location) const
+{
+	const float Size = FMath::Max(CellSize, 1.f);
+	return FIntVector(FMath::FloorToInt(Location.X / Size), FMath::FloorToInt(Location.Y / Size), FMath::FloorToInt(Location.Z / Size));
+}
+
+bool UInteractionSubsystem::GetCellRange(const FVector& Location, const float MaxDistance, FIntVector& OutMinCell, FIntVector& OutMaxCell) const
+{
+	// nothing can be interacted with from further than the largest interaction distance
+	const float Radius = FMath::Min(MaxDistance, MaxInteractionDistance);
+	if (Radius <= 0.f)
+	{
+		return false;
+	}
+
+	OutMinCell = GetCell(Location - FVector(Radius));
+	OutMaxCell = GetCell(Location + FVector(Radius));
+	return true;
+}
+
+void UInteractionSubsystem::MarkCellChanged(const FIntVector& Cell)
+{
+	CellStamps.FindOrAdd(Cell) = ++ChangeCounter;
+}
+
+void UInteractionSubsystem::NotifyInteractableChanged(UInteractionComponent* Interactable)
+{
+	if (const FIntVector* Cell = InteractableCells.Find(Interactable))
+	{
+		MarkCellChanged(*Cell);
+	}
+}
+
+uint32 UInteractionSubsystem::GetChangeStamp(const FVector& Location, const float MaxDistance) const
+{
+	FIntVector MinCell, MaxCell;
+	if (!GetCellRange(Location, MaxDistance, MinCell, MaxCell))
+	{
+		return 0;
+	}
+
+	// the newest stamp of the cells in range, it only goes up so any change in range makes it differ from an older one
+	uint32 Stamp = 0;
+	for (int32 X = MinCell.X; X <= MaxCell.X; ++X)
+	{
+		for (int32 Y = MinCell.Y; Y <= MaxCell.Y; ++Y)
+		{
+			for (int32 Z = MinCell.Z; Z <= MaxCell.Z; ++Z)
+			{
+				if (const uint32* CellStamp = CellStamps.Find(FIntVector(X, Y, Z)))
+				{
+					Stamp = FMath::Max(Stamp, *CellStamp);
+				}
+			}
+		}
+	}
+
+	return Stamp;
+}
+
+void UInteractionSubsystem::AddInteractable(UInteractionComponent* Interactable)
+{
+	if (!Interactable || InteractableCells.Contains(Interactable))
+	{
+		return;
+	}
+
+	const FIntVector Cell = GetCell(Interactable->GetComponentLocation());
+	Cells.FindOrAdd(Cell).Add(Interactable);
+	InteractableCells.Add(Interactable, Cell);
+	MarkCellChanged(Cell);
+
+	MaxInteractionDistance = FMath::Max(MaxInteractionDistance, Interactable->InteractionDistance);
+
+	INC_DWORD_STAT(STAT_InteractionRegistered);
+}
+
+void UInteractionSubsystem::RemoveInteractable(UInteractionComponent* Interactable)
+{
+	FIntVector Cell;
+	if (!InteractableCells.RemoveAndCopyValue(Interactable, Cell))
+	{
+		return;
+	}
+
+	MarkCellChanged(Cell);
+
+	// drop the cell once its empty so the map doesn't keep every cell anything has passed through
+	if (TArray<UInteractionComponent*>* CellInteractables = Cells.Find(Cell))
+	{
+		CellInteractables->RemoveSingleSwap(Interactable, false);
+		if (CellInteractables->Num() == 0)
+		{
+			Cells.Remove(Cell);
+		}
+	}
+
+	DEC_DWORD_STAT(STAT_InteractionRegistered);
+}
+
+void UInteractionSubsystem::UpdateInteractable(UInteractionComponent* Interactable)
+{
+	FIntVector* CurrentCell = InteractableCells.Find(Interactable);
+	if (!CurrentCell)
+	{
+		return;
+	}
+
+	// most moves stay inside the same cell
+	const FIntVector NewCell = GetCell(Interactable->GetComponentLocation());
+	if (NewCell == *CurrentCell)
+	{
+		return;
+	}
+
+	if (TArray<UInteractionComponent*>* OldInteractables = Cells.Find(*CurrentCell))
+	{
+		OldInteractables->RemoveSingleSwap(Interactable, false);
+		if (OldInteractables->Num() == 0)
+		{
+			Cells.Remove(*CurrentCell);
+		}
+	}
+
+	Cells.FindOrAdd(NewCell).Add(Interactable);
+	MarkCellChanged(*CurrentCell);
+	MarkCellChanged(NewCell);
+	*CurrentCell = NewCell;
+}
+
+UInteractionComponent* UInteractionSubsystem::FindInteractable(const FVector& ViewLocation, const FVector& ViewDirection, const float MaxDistance, const float ConeAngle, const AActor* Viewer)
+{
+	SCOPE_CYCLE_COUNTER(STAT_InteractionCheck);
+
+	FIntVector MinCell, MaxCell;
+	if (!GetCellRange(ViewLocation, MaxDistance, MinCell, MaxCell))
+	{
+		return nullptr;
+	}
+
+	const float Radius = FMath::Min(MaxDistance, MaxInteractionDistance);
+	const float MinCosAngle = FMath::Cos(FMath::DegreesToRadians(FMath::Clamp(ConeAngle, 0.f, 180.f)));
+
+	Candidates.Reset();
+
+	for (int32 X = MinCell.X; X <= MaxCell.X; ++X)
+	{
+		for (int32 Y = MinCell.Y; Y <= MaxCell.Y; ++Y)
+		{
+			for (int32 Z = MinCell.Z; Z <= MaxCell.Z; ++Z)
+			{
+				const TArray<UInteractionComponent*>* CellInteractables = Cells.Find(FIntVector(X, Y, Z));
+				if (!CellInteractables)
+				{
+					continue;
+				}
+
+				for (UInteractionComponent* Interactable : *CellInteractables)
+				{
+					// inactive interactables, like a player that is still alive, are skipped
+					if (!Interactable->IsActive() || Interactable->GetOwner() == Viewer)
+					{
+						continue;
+					}
+
+					const FVector ToInteractable = Interactable->GetComponentLocation() - ViewLocation;
+					const float Distance = ToInteractable.Size();
+					if (Distance > Radius || Distance > Interactable->InteractionDistance)
+					{
+						continue;
+					}
+
+					// anything the player is standing on top of counts as in view
+					const float CosAngle = Distance > KINDA_SMALL_NUMBER ? FVector::DotProduct(ToInteractable / Distance, ViewDirection) : 1.f;
+					if (CosAngle < MinCosAngle)
+					{
+						continue;
+					}
+
+					// closest to the center of view wins, with closer interactables winning ties
+					Candidates.Emplace(CosAngle - DistanceWeight * (Distance / Radius), Interactable);
+				}
+			}
+		}
+	}
+
+	INC_DWORD_STAT_BY(STAT_InteractionCandidates, Candidates.Num());
+
+	if (Candidates.Num() == 0)
+	{
+		return nullptr;
+	}
+
+	Candidates.Sort([](const TPair<float, UInteractionComponent*>& A, const TPair<float, UInteractionComponent*>& B)
+	{
+		return A.Key > B.Key;
+	});
+
+	// only the best candidates get an occlusion trace
+	const int32 NumTraces = FMath::Min(Candidates.Num(), FMath::Max(MaxOcclusionTraces, 1));
+	for (int32 i = 0; i < NumTraces; ++i)
+	{
+		if (IsVisible(ViewLocation, Candidates[i].Value, Viewer))
+		{
+			return Candidates[i].Value;
+		}
+	}
+
+	return nullptr;
+}
+
+bool UInteractionSubsystem::CheckVisibility(const FVector& ViewLocation, const UInteractionComponent* Interactable, const AActor* Viewer, bool& bOutVisible)
+{
+	// the budget is per frame, shared by every player
+	if (ValidationTraceFrame != GFrameCounter)
+	{
+		ValidationTraceFrame = GFrameCounter;
+		NumValidationTraces = 0;
+	}
+
+	if (NumValidationTraces >= MaxValidationTracesPerFrame)
+	{
+		INC_DWORD_STAT(STAT_InteractionValidationsOverBudget);
+		return false;
+	}
+
+	++NumValidationTraces;
+	INC_DWORD_STAT(STAT_InteractionValidationTraces);
+
+	bOutVisible = IsVisible(ViewLocation, Interactable, Viewer);
+	return true;
+}
+
+bool UInteractionSubsystem::IsVisible(const FVector& ViewLocation, const UInteractionComponent* Interactable, const AActor* Viewer) const
+{
+	INC_DWORD_STAT(STAT_InteractionTraces);
+
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(InteractionOcclusionTrace));
+	QueryParams.AddIgnoredActor(Viewer);
+
+	// the interactable is usually inside its owners mesh, so hitting the owner means it's in view
+	FHitResult Hit;
+	if (!GetWorld()->LineTraceSingleByChannel(Hit, ViewLocation, Interactable->GetComponentLocation(), ECC_Visibility, QueryParams))
+	{
+		return true;
+	}
+
+	return Hit.GetActor() == Interactable->GetOwner();
+}
@@ -0,0 +1,116 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "InteractionSubsystem.generated.h"
+
+class UInteractionComponent;
+
+/**
+ * Registry of every interaction component in the world, stored in a uniform grid of cells
+ * Interaction checks query the cells around the player for the interactable closest to the center of their view,
+ * and only the best candidates are traced to make sure nothing is in the way
+ */
+UCLASS(Config = Game)
+class TROLLED_API UInteractionSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	// clears the grid
+	virtual void Deinitialize() override;
+
+	// adds an interaction component to the grid, called when the component registers
+	void AddInteractable(UInteractionComponent* Interactable);
+
+	// removes an interaction component from the grid, called when the component unregisters
+	void RemoveInteractable(UInteractionComponent* Interactable);
+
+	// moves an interaction component to the cell it is in now, called whenever the component moves
+	void UpdateInteractable(UInteractionComponent* Interactable);
+
+	// marks the cell of an interaction component as changed, called when the component is turned on or off
+	void NotifyInteractableChanged(UInteractionComponent* Interactable);
+
+	/** Returns a stamp that changes whenever an interactable is added, removed, turned on or off, or moves into or out of a cell near a location
+	 * Interaction checks compare it to the stamp from their last check to know if anything near the player has changed
+	 * @param Location where the player is looking from
+	 * @param MaxDistance max distance of the interaction check */
+	uint32 GetChangeStamp(const FVector& Location, const float MaxDistance) const;
+
+	/** Finds the interactable a player is looking at
+	 * @param ViewLocation where the player is looking from
+	 * @param ViewDirection normalized direction the player is looking in
+	 * @param MaxDistance max distance of the check, each interactable also limits this to its own interaction distance
+	 * @param ConeAngle half angle in degrees of the view cone an interactable has to be in
+	 * @param Viewer actor doing the check, its own interactables are skipped and it is ignored by the occlusion trace
+	 * @return the best visible interactable, null if there isn't one */
+	UInteractionComponent* FindInteractable(const FVector& ViewLocation, const FVector& ViewDirection, const float MaxDistance, const float ConeAngle, const AActor* Viewer);
+
+	/** [server] Checks that nothing is in the way between a client and the interactable it wants to interact with
+	 * Traces are limited to MaxValidationTracesPerFrame across every player so interact spam can't cause trace spikes
+	 * @param ViewLocation where the player is looking from
+	 * @param Interactable interactable to check
+	 * @param Viewer actor doing the check, ignored by the trace
+	 * @param bOutVisible whether the interactable is in view, only set if the trace was done
+	 * @return false if the trace budget for this frame is used up */
+	bool CheckVisibility(const FVector& ViewLocation, const UInteractionComponent* Interactable, const AActor* Viewer, bool& bOutVisible);
+
+	// number of interaction components in the grid
+	FORCEINLINE int32 GetNumInteractables() const { return InteractableCells.Num(); }
+
+	// size of a grid cell, around the interaction distance keeps a check to a handful of cells
+	UPROPERTY(Config)
+	float CellSize = 400.f;
+
+	// how much the distance to an interactable counts against it compared to how far it is from the center of view
+	UPROPERTY(Config)
+	float DistanceWeight = 0.1f;
+
+	// max occlusion traces per check, if the best candidate is blocked the next best is tried
+	UPROPERTY(Config)
+	int32 MaxOcclusionTraces = 2;
+
+	// max occlusion traces per frame the server does to validate what clients are interacting with
+	UPROPERTY(Config)
+	int32 MaxValidationTracesPerFrame = 8;
+
+private:
+
+	// cell a location is in
+	FIntVector GetCell(const FVector& Location) const;
+
+	// range of cells an interaction check from a location could find interactables in, false if nothing can be in range
+	bool GetCellRange(const FVector& Location, const float MaxDistance, FIntVector& OutMinCell, FIntVector& OutMaxCell) const;
+
+	// bumps the change stamp of a cell
+	void MarkCellChanged(const FIntVector& Cell);
+
+	// traces from the view to the interactable, true if nothing but the interactables owner is in the way
+	bool IsVisible(const FVector& ViewLocation, const UInteractionComponent* Interactable, const AActor* Viewer) const;
+
+	// interaction components in each cell
+	TMap<FIntVector, TArray<UInteractionComponent*>> Cells;
+
+	// cell each interaction component is in, components are always removed when they unregister
+	TMap<UInteractionComponent*, FIntVector> InteractableCells;
+
+	// change stamp of each cell anything has been added to or removed from, cells keep their stamp once empty
+	TMap<FIntVector, uint32> CellStamps;
+
+	// last change stamp handed out
+	uint32 ChangeCounter = 0;
+
+	// largest interaction distance registered, a check never needs to look further than this
+	float MaxInteractionDistance = 0.f;
+
+	// frame the validation trace budget was last reset, and how much of it is used
+	uint64 ValidationTraceFrame = 0;
+	int32 NumValidationTraces = 0;
+
+	// scored candidates of the last check, kept to reuse the allocation
+	TArray<TPair<float, UInteractionComponent*>> Candidates;
+};
@@ -3,10 +3,86 @@
 #include "InventoryComponent.h"
 #include "Net/UnrealNetwork.h"
 #include "Engine/ActorChannel.h"
+#include "Engine/World.h"
+#include "GameFramework/Pawn.h"
+#include "TimerManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "UObject/SoftObjectPath.h"
+#include "Trolled/Items/AmmoItem.h"
+#include "Trolled/Items/EquippableItem.h"
+#include "Trolled/Framework/TrolledGameInstance.h"
+#include "Trolled/Trolled.h"
 
 // namespace used for language localization
 #define LOCTEXT_NAMESPACE "Inventory"
 
+// goes up when items are added or equipped, not when stacks change as those are sent as InventoryList deltas. Compare with netprofile when looting chests
+DECLARE_DWORD_COUNTER_STAT(TEXT("Item Subobjects Replicated"), STAT_InventorySubobjectsReplicated, STATGROUP_TrolledInventory);
+
+#if !UE_BUILD_SHIPPING
+// compares the class index against the old scan of the inventory array on a full 200 slot inventory
+static FAutoConsoleCommandWithWorldAndArgs InventoryBenchmarkCommand(
+	TEXT("Trolled.InventoryBenchmark"),
+	TEXT("Times class lookups on a full inventory against a scan of the inventory array. Server only. Usage: Trolled.InventoryBenchmark [NumLookups=100000]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic([](const TArray<FString>& Args, UWorld* World)
+	{
+		if (!World || World->GetNetMode() == NM_Client)
+		{
+			return;
+		}
+
+		// a throwaway actor to own the inventory, items can only be added with authority
+		if (AActor* Container = World->SpawnActor<AActor>())
+		{
+			UInventoryComponent* Inventory = NewObject<UInventoryComponent>(Container);
+			Inventory->RegisterComponent();
+			Inventory->SetInventoryCapacity(200);
+
+			Inventory->RunLookupBenchmark(FMath::Max(Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 100000, 1));
+
+			Container->Destroy();
+		}
+	}));
+
+// save and load throughput of a full 200 slot inventory snapshot
+static FAutoConsoleCommandWithWorldAndArgs InventorySnapshotBenchmarkCommand(
+	TEXT("Trolled.InventorySnapshotBenchmark"),
+	TEXT("Times saving and loading snapshots of a full inventory. Server only. Usage: Trolled.InventorySnapshotBenchmark [Iterations=1000]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic([](const TArray<FString>& Args, UWorld* World)
+	{
+		if (!World || World->GetNetMode() == NM_Client)
+		{
+			return;
+		}
+
+		// a throwaway actor to own the inventory, items can only be added with authority
+		if (AActor* Container = World->SpawnActor<AActor>())
+		{
+			UInventoryComponent* Inventory = NewObject<UInventoryComponent>(Container);
+			Inventory->RegisterComponent();
+			Inventory->SetInventoryCapacity(200);
+
+			Inventory->RunSnapshotBenchmark(FMath::Max(Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 1000, 1));
+
+			Container->Destroy();
+		}
+	}));
+#endif
+
+// first bytes of every inventory snapshot, "TINV"
+static const uint32 InventorySnapshotMagic = 0x564E4954;
+
+// bump when the snapshot layout changes, LoadSnapshot has to keep reading older versions
+static const uint8 InventorySnapshotVersion = 1;
+
+// per stack flags in a snapshot
+enum EInventorySnapshotFlags : uint8
+{
+	ISF_Equipped = 1 << 0
+};
+
 // Sets default values for this component's properties
 UInventoryComponent::UInventoryComponent()
 {
@@ -14,21 +90,30 @@ UInventoryComponent::UInventoryComponent()
 	// useful for keeping loot on a corpse and preventing players from modding inventory without server knowing
 	SetIsReplicated(true);
 
+	// lets the replicated entries call back into the inventory
+	InventoryList.OwnerInventory = this;
+
+	// LootList calls back into the looted inventory, set on clients when looting starts
+	LootList.OwnerInventory = nullptr;
 
 }
 
 // exposed version for item instance that just calls TryAddItem_Internal
 FItemAddResult UInventoryComponent::TryAddItem(class UBaseItem* Item) 
 {
-	return TryAddItem_Internal(Item);
+	return TryAddItem_Internal(FItemInstance(Item->GetClass(), Item->GetQuantity()));
 }
 
 // exposed version for item class that just calls TryAddItem_Internal
 FItemAddResult UInventoryComponent::TryAddItemFromClass(TSubclassOf<class UBaseItem> ItemClass, const int32 Quantity) 
 {
-	UBaseItem* Item = NewObject<UBaseItem>(GetOwner(), ItemClass);
-	Item->SetQuantity(Quantity);
-	return TryAddItem_Internal(Item);
+	return TryAddItem_Internal(FItemInstance(ItemClass, Quantity));
+}
+
+// exposed version for item instance structs that just calls TryAddItem_Internal
+FItemAddResult UInventoryComponent::TryAddItemInstance(const FItemInstance& Instance)
+{
+	return TryAddItem_Internal(Instance);
 }
 
 int32 UInventoryComponent::ConsumeAll(class UBaseItem* Item) 
@@ -55,15 +140,11 @@ int32 UInventoryComponent::ConsumeQuantity(class UBaseItem* Item, const int32 Qu
 		Item->SetQuantity(Item->GetQuantity() - RemoveQuantity);
 
 		// if its 0, remove the item from inventory
+		// the new quantity reaches the client through the items entry
 		if (Item->GetQuantity() <= 0)
 		{
 			RemoveItem(Item);
 		}
-		else
-		{
-			// forces client to update inventory, reflecting new item quantity
-			ClientRefreshInventory();
-		}
 		
 		return RemoveQuantity;
 	}
@@ -71,7 +152,6 @@ int32 UInventoryComponent::ConsumeQuantity(class UBaseItem* Item, const int32 Qu
 }
 
 // remove item from inventory
-// TODO: Create function like RemoveItem, but for multiple items
 bool UInventoryComponent::RemoveItem(class UBaseItem* Item) 
 {
 	// Check to force the server to remove the item, not the client. Prevents cheating or improper removal of items client side
@@ -81,14 +161,21 @@ bool UInventoryComponent::RemoveItem(class UBaseItem* Item)
 		if (Item)
 		{
 			// remove item from inventory array
-			InventoryArray.RemoveSingle(Item);
-
-			//OnItemRemoved.Broadcast(Item);
+			if (InventoryArray.RemoveSingle(Item) > 0)
+			{
+				UnindexItem(Item);
+			}
 
-			OnRep_InventoryArray();
+			// removing the entry is all clients need, the item itself doesn't have to replicate again
+			const int32 EntryIndex = InventoryList.Entries.IndexOfByPredicate([Item](const FInventoryEntry& Entry) { return Entry.Item == Item; });
+			if (EntryIndex != INDEX_NONE)
+			{
+				InventoryList.Entries.RemoveAtSwap(EntryIndex);
+				InventoryList.MarkArrayDirty();
+			}
 
-			// increments the rep key so the server knows it needs to push updates to the client
-			ReplicatedItemsKey++;
+			// tells the UI to update
+			QueueChange(Item, EInventoryChangeType::ICT_Removed);
 
 			return true;
 		}
@@ -98,46 +185,194 @@ bool UInventoryComponent::RemoveItem(class UBaseItem* Item)
 	return false;
 }
 
-// checks if the item has the current quantity or greater
-bool UInventoryComponent::HasItemQuantity(TSubclassOf <class UBaseItem> ItemClass, const int32 Quantity) const
+void UInventoryComponent::RemoveItems(const TArray<class UBaseItem*>& Items)
 {
-	if (UBaseItem* ItemToFind = FindItemByClass(ItemClass))
+	if (Items.Num() == 0)
 	{
-		return ItemToFind->GetQuantity() >= Quantity;
+		return;
+	}
+
+	for (UBaseItem* Item : Items)
+	{
+		if (InventoryArray.RemoveSingle(Item) > 0)
+		{
+			UnindexItem(Item);
+			QueueChange(Item, EInventoryChangeType::ICT_Removed);
+		}
+	}
+
+	// drop every removed entry in one go, the array is only marked dirty once
+	const int32 NumRemoved = InventoryList.Entries.RemoveAllSwap([&Items](const FInventoryEntry& Entry) { return Items.Contains(Entry.Item); });
+	if (NumRemoved > 0)
+	{
+		InventoryList.MarkArrayDirty();
 	}
-	return false;
 }
 
-UBaseItem* UInventoryComponent::FindItem(class UBaseItem* Item) const
+int32 UInventoryComponent::TransferItems(class UInventoryComponent* Destination, const TArray<class UBaseItem*>& Items, FText& OutErrorText)
 {
-	// loop through inventory
-	for (auto& InvItem : InventoryArray)
+	OutErrorText = FText::GetEmpty();
+
+	if (!GetOwner() || !GetOwner()->HasAuthority() || !Destination || Destination == this)
+	{
+		return 0;
+	}
+
+	// only stacks that are actually in this inventory, the list can come from a client
+	TArray<UBaseItem*> MovingItems;
+	TArray<FItemInstance> Instances;
+	for (UBaseItem* Item : Items)
+	{
+		const FItemClassEntry* Entry = Item ? ClassIndex.Find(Item->GetClass()) : nullptr;
+		if (Entry && Entry->Stacks.Contains(Item) && !MovingItems.Contains(Item))
+		{
+			MovingItems.Add(Item);
+			Instances.Add(FItemInstance(Item->GetClass(), Item->GetQuantity()));
+		}
+	}
+
+	// placement for every stack is planned together using the destinations stacking and weight rules
+	const TArray<FItemAddResult> AddResults = Destination->TryAddItems(Instances);
+
+	int32 TotalMoved = 0;
+	TArray<UBaseItem*> EmptiedItems;
+
+	for (int32 i = 0; i < MovingItems.Num(); ++i)
 	{
-		// if item is valid and item has the class we're looking for, return item
-		if (InvItem && InvItem->GetClass() == Item->GetClass())
+		UBaseItem* Item = MovingItems[i];
+		const FItemAddResult& AddResult = AddResults[i];
+		if (AddResult.ActualAmountGiven < AddResult.AmountToGive)
 		{
-			return InvItem;
+			OutErrorText = AddResult.ErrorText;
 		}
 
+		if (AddResult.ActualAmountGiven <= 0)
+		{
+			continue;
+		}
+
+		TotalMoved += AddResult.ActualAmountGiven;
+
+		// partly moved stacks only need their entry updated, emptied ones are removed together below
+		if (AddResult.ActualAmountGiven >= Item->GetQuantity())
+		{
+			EmptiedItems.Add(Item);
+		}
+		else
+		{
+			Item->SetQuantity(Item->GetQuantity() - AddResult.ActualAmountGiven);
+		}
 	}
-	return nullptr;
-	
+
+	RemoveItems(EmptiedItems);
+
+	return TotalMoved;
 }
 
-// takes in item class, then searches for it in the inventory array
-UBaseItem* UInventoryComponent::FindItemByClass(TSubclassOf<class UBaseItem> ItemClass) const
+int32 UInventoryComponent::TransferAllItems(class UInventoryComponent* Destination, FText& OutErrorText)
 {
-	// loop through inventory
-	for (auto& InvItem : InventoryArray)
+	// copy as emptied stacks are removed from InventoryArray during the transfer
+	const TArray<UBaseItem*> Items = InventoryArray;
+	return TransferItems(Destination, Items, OutErrorText);
+}
+
+void UInventoryComponent::QueueChange(class UBaseItem* Item, const EInventoryChangeType ChangeType)
+{
+	if (!Item)
+	{
+		return;
+	}
+
+	// anything else that happens to a new item is already covered by its add
+	const bool bAddPending = PendingChanges.ContainsByPredicate([Item](const FInventoryChange& Change) { return Change.Item == Item && Change.ChangeType == EInventoryChangeType::ICT_Added; });
+
+	if (ChangeType == EInventoryChangeType::ICT_Removed)
+	{
+		// earlier changes to a removed item don't matter, and an item added and removed in the same frame was never seen
+		PendingChanges.RemoveAll([Item](const FInventoryChange& Change) { return Change.Item == Item; });
+		if (!bAddPending)
+		{
+			PendingChanges.Add(FInventoryChange(Item, ChangeType));
+		}
+	}
+	else if (!bAddPending || ChangeType == EInventoryChangeType::ICT_Added)
 	{
-		// if item is valid and item has the class we're looking for, return item
-		if (InvItem && InvItem->GetClass() == ItemClass)
+		// one entry per item and type, however many times it changed
+		if (!PendingChanges.ContainsByPredicate([Item, ChangeType](const FInventoryChange& Change) { return Change.Item == Item && Change.ChangeType == ChangeType; }))
 		{
-			return InvItem;
+			PendingChanges.Add(FInventoryChange(Item, ChangeType));
 		}
+	}
 
+	// every server side change goes through here, so this is where the journal hears about them
+	if (!JournalKey.IsNone() && GetOwner() && GetOwner()->HasAuthority())
+	{
+		JournalClass(Item->GetClass());
 	}
-	return nullptr;
+
+	QueueBroadcast();
+}
+
+void UInventoryComponent::QueueBroadcast()
+{
+	UWorld* World = GetWorld();
+	if (!bBroadcastPending && World)
+	{
+		bBroadcastPending = true;
+		World->GetTimerManager().SetTimerForNextTick(this, &UInventoryComponent::BroadcastChanges);
+	}
+}
+
+void UInventoryComponent::BroadcastChanges()
+{
+	bBroadcastPending = false;
+
+	// looters get this frames changes in one sync
+	if (PendingChanges.Num() > 0 && GetOwner() && GetOwner()->HasAuthority())
+	{
+		for (int32 i = Looters.Num() - 1; i >= 0; --i)
+		{
+			if (UInventoryComponent* Looter = Looters[i].Get())
+			{
+				Looter->SyncLootList(this);
+			}
+			else
+			{
+				Looters.RemoveAtSwap(i);
+			}
+		}
+	}
+
+	// moved out first, a listener changing the inventory queues a new broadcast
+	const TArray<FInventoryChange> Changes = MoveTemp(PendingChanges);
+	PendingChanges.Reset();
+
+	OnInventoryChanged.Broadcast(Changes);
+	OnInventoryUpdated.Broadcast();
+}
+
+// checks if the item has the current quantity or greater
+bool UInventoryComponent::HasItemQuantity(TSubclassOf <class UBaseItem> ItemClass, const int32 Quantity) const
+{
+	return GetItemQuantity(ItemClass) >= Quantity;
+}
+
+int32 UInventoryComponent::GetItemQuantity(TSubclassOf <class UBaseItem> ItemClass) const
+{
+	const FItemClassEntry* Entry = ClassIndex.Find(ItemClass);
+	return Entry ? Entry->TotalQuantity : 0;
+}
+
+UBaseItem* UInventoryComponent::FindItem(class UBaseItem* Item) const
+{
+	return Item ? FindItemByClass(Item->GetClass()) : nullptr;
+}
+
+// takes in item class, then looks up its first stack in the class index
+UBaseItem* UInventoryComponent::FindItemByClass(TSubclassOf<class UBaseItem> ItemClass) const
+{
+	const FItemClassEntry* Entry = ClassIndex.Find(ItemClass);
+	return Entry && Entry->Stacks.Num() > 0 ? Entry->Stacks[0] : nullptr;
 }
 
 TArray<UBaseItem*> UInventoryComponent::FindAllItemsByClass(TSubclassOf<class UBaseItem> ItemClass) const
@@ -158,39 +393,22 @@ TArray<UBaseItem*> UInventoryComponent::FindAllItemsByClass(TSubclassOf<class UB
 	return ItemsOfClass;
 }
 
-// uses GetStackWeight to multiply current stack size by individual item weight
+// running total kept up to date as items are added, removed and change quantity
 float UInventoryComponent::GetCurrentWeight() const
 {
-	float Weight = 0.f;
-
-	for (auto& Item : InventoryArray)
-	{
-		if(Item)
-		{
-			Weight += Item->GetStackWeight();
-		}
-	}
-
-	return Weight;
+	return CurrentWeight;
 }
 
 void UInventoryComponent::SetWeightCapacity(const float NewWeightCapacity) 
 {
 	WeightCapacity = NewWeightCapacity;
-	OnInventoryUpdated.Broadcast();
+	QueueBroadcast();
 }
 
 void UInventoryComponent::SetInventoryCapacity(const int32 NewInventoryCapacity) 
 {
 	InventoryCapacity = NewInventoryCapacity;
-	OnInventoryUpdated.Broadcast();
-}
-
-// called when items in inventory change
-void UInventoryComponent::ClientRefreshInventory_Implementation() 
-{
-	// calls the delegate to update the UI	
-	OnInventoryUpdated.Broadcast();
+	QueueBroadcast();
 }
 
 void UInventoryComponent::GetLifetimeReplicatedProps(TArray<class FLifetimeProperty> & OutLifetimeProps) const 
@@ -198,7 +416,9 @@ void UInventoryComponent::GetLifetimeReplicatedProps(TArray<class FLifetimePrope
 	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
 
     // replicates and makes the server manage the quantity value
-    DOREPLIFETIME(UInventoryComponent, InventoryArray);
+    // only the owner sees the contents, anyone else looting gets them in their own LootList
+    DOREPLIFETIME_CONDITION(UInventoryComponent, InventoryList, COND_OwnerOnly);
+    DOREPLIFETIME_CONDITION(UInventoryComponent, LootList, COND_OwnerOnly);
 }
 
 bool UInventoryComponent::ReplicateSubobjects(class UActorChannel *Channel, class FOutBunch *Bunch, FReplicationFlags *RepFlags) 
@@ -206,7 +426,28 @@ bool UInventoryComponent::ReplicateSubobjects(class UActorChannel *Channel, clas
 	// true when a modification has been made to actor channel
 	bool bWroteSomething = Super::ReplicateSubobjects(Channel, Bunch, RepFlags);
 
-	// check if the array of items needs to replicate
+	// the owner and looters get every item, anyone else only needs a characters equippables to see their gear
+	const bool bSendAllItems = (GetOwner() && Channel->Connection == GetOwner()->GetNetConnection()) || IsLootedBy(Channel->Connection);
+	if (!bSendAllItems)
+	{
+		// separate key from the full check below, so a connection that starts looting still gets what it skipped
+		if (Cast<APawn>(GetOwner()) && Channel->KeyNeedsToReplicate(1, ReplicatedItemsKey))
+		{
+			for (UBaseItem* Item : InventoryArray)
+			{
+				if (Item && Item->IsA<UEquippableItem>() && Channel->KeyNeedsToReplicate(Item->GetUniqueID(), Item->RepKey))
+				{
+					bWroteSomething |= Channel->ReplicateSubobject(Item, *Bunch, *RepFlags);
+					INC_DWORD_STAT(STAT_InventorySubobjectsReplicated);
+				}
+			}
+		}
+
+		return bWroteSomething;
+	}
+
+	// check if the array of items needs to replicate, the key changes when an item is added or equipped
+	// quantity changes and removals go through InventoryList, so this is skipped entirely for them
 	if (Channel->KeyNeedsToReplicate(0, ReplicatedItemsKey))
 	{
 		// loops through inventory array
@@ -216,6 +457,7 @@ bool UInventoryComponent::ReplicateSubobjects(class UActorChannel *Channel, clas
 			if (Channel->KeyNeedsToReplicate(Item->GetUniqueID(), Item->RepKey))
 			{
 				bWroteSomething |= Channel->ReplicateSubobject(Item, *Bunch, *RepFlags);
+				INC_DWORD_STAT(STAT_InventorySubobjectsReplicated);
 			}
 		}
 	}
@@ -223,196 +465,873 @@ bool UInventoryComponent::ReplicateSubobjects(class UActorChannel *Channel, clas
 	return bWroteSomething;
 }
 
-// called when items in inventory change
-void UInventoryComponent::OnRep_InventoryArray() 
+void UInventoryComponent::OnEntryAdded(const FInventoryEntry& Entry)
 {
-	// calls the delegate to update the UI	
-	OnInventoryUpdated.Broadcast();
-
-	// less performance intense method to set world on items moving into inventory
-	// may miss items if a large number are added to the inventory at once
-	// if inventory has items
-	// if (InventoryArray.Num())
-	// {
-	// 	// find the latest item to get added to the inventory
-	// 	if (UBaseItem* NewItem = InventoryArray.Last())
-	// 	{
-	// 		// set the world of that item
-	// 		NewItem->World = GetWorld();
-	// 	}
-	// }
-
-	// tutorial says this may be overkill and could cause performace hits with large inventories
-	for (auto& Item : InventoryArray)
+	// the item may not have arrived yet, the entry changes again once it has
+	if (UBaseItem* Item = Entry.Item)
 	{
-		// check for valid item and item not having a world
-		if (Item && !Item->World)
+		// set the world on the item, and the owning inventory so its quantity changes reach the class index
+		Item->World = GetWorld();
+		Item->OwningInventory = this;
+		Item->Quantity = Entry.Quantity;
+
+		if (!InventoryArray.Contains(Item))
 		{
-			//OnItemAdded.Broadcast(Item);
+			InventoryArray.Add(Item);
+			IndexItem(Item);
 
-			// set the world on the item
-			Item->World = GetWorld();
+			// tells the UI to update
+			QueueChange(Item, EInventoryChangeType::ICT_Added);
 		}
+
+		ApplyEntryEquipped(Item, Entry);
 	}
 }
 
-// original method, not sure if items is supposed to ref to the thing i renamed InventoryArray
-// called when items in inventory change
-// void UInventoryComponent::OnRep_Items() 
-// {
-// 	// calls the delegate to update the UI	
-// 	OnInventoryUpdated.Broadcast();
+void UInventoryComponent::OnEntryChanged(const FInventoryEntry& Entry)
+{
+	UBaseItem* Item = Entry.Item;
+	if (!Item)
+	{
+		return;
+	}
 
-// 	for (auto& Item : InventoryArray)
-// 	{
-// 		//On the client the world won't be set initially, so it set if not
-// 		if (!Item->World)
-// 		{
-// 			OnItemAdded.Broadcast(Item);
-// 			Item->World = GetWorld();
-// 		}
-// 	}
-// }
+	// an item that wasn't there when the entry was added
+	if (!InventoryArray.Contains(Item))
+	{
+		OnEntryAdded(Entry);
+		return;
+	}
+
+	Item->Quantity = Entry.Quantity;
+	RefreshClassTotals(Item);
+
+	Item->OnItemModified.Broadcast();
+	QueueChange(Item, EInventoryChangeType::ICT_QuantityChanged);
 
-UBaseItem* UInventoryComponent::AddItem(class UBaseItem* Item)
+	ApplyEntryEquipped(Item, Entry);
+}
+
+void UInventoryComponent::ApplyEntryEquipped(class UBaseItem* Item, const FInventoryEntry& Entry)
 {
-	// Check to force the server to add the item, not the client. Prevents cheating or improper added of items client side
-	// !!! GetOwner()->HasAuthority() didnt work when previously implemented on character? !!!
-	if(GetOwner() && GetOwner()->HasAuthority())
+	// runs the same equip/unequip the server did, only when the state actually changed
+	UEquippableItem* Equippable = Cast<UEquippableItem>(Item);
+	if (Equippable && Equippable->bEquipped != Entry.bEquipped)
 	{
-		// recreates a new item from the item being passed in, but sets the owner to the current player and adds to inventory
-		UBaseItem* NewItem = NewObject<UBaseItem>(GetOwner(), Item->GetClass());
-		NewItem->World = GetWorld();
-		NewItem->SetQuantity(Item->GetQuantity());
-		NewItem->OwningInventory = this;
-		NewItem->AddedToInventory(this);
-		InventoryArray.Add(NewItem);
-		NewItem->MarkDirtyForReplication();
-		//OnItemAdded.Broadcast(NewItem);
-		OnRep_InventoryArray();
+		Equippable->bEquipped = Entry.bEquipped;
+		Equippable->EquipStatusChanged();
+	}
+}
 
+void UInventoryComponent::OnEntryRemoved(const FInventoryEntry& Entry)
+{
+	if (UBaseItem* Item = Entry.Item)
+	{
+		if (InventoryArray.RemoveSingle(Item) > 0)
+		{
+			UnindexItem(Item);
+			QueueChange(Item, EInventoryChangeType::ICT_Removed);
+		}
+	}
+}
 
-		return NewItem;
+void FInventoryEntry::PreReplicatedRemove(const FInventoryList& InArraySerializer)
+{
+	if (InArraySerializer.OwnerInventory)
+	{
+		InArraySerializer.OwnerInventory->OnEntryRemoved(*this);
 	}
+}
 
-	// if the server isnt the one calling add item, return null
-	return nullptr;
+void FInventoryEntry::PostReplicatedAdd(const FInventoryList& InArraySerializer)
+{
+	if (InArraySerializer.OwnerInventory)
+	{
+		InArraySerializer.OwnerInventory->OnEntryAdded(*this);
+	}
 }
 
-FItemAddResult UInventoryComponent::TryAddItem_Internal(class UBaseItem* Item) 
+void FInventoryEntry::PostReplicatedChange(const FInventoryList& InArraySerializer)
 {
-	if (GetOwner() && GetOwner()->HasAuthority())
+	if (InArraySerializer.OwnerInventory)
 	{
-		// determine the quantity the character is trying to add
-		const int32 AddAmount = Item->GetQuantity();
+		InArraySerializer.OwnerInventory->OnEntryChanged(*this);
+	}
+}
+
+void UInventoryComponent::IndexItem(class UBaseItem* Item)
+{
+	FItemClassEntry& Entry = ClassIndex.FindOrAdd(Item->GetClass());
+	Entry.Stacks.Add(Item);
+	Entry.TotalQuantity += Item->GetQuantity();
+	CurrentWeight += Item->GetStackWeight();
+}
 
-		// if current inventory + 1 is bigger than inventory capacity, character is full
-		if (InventoryArray.Num() + 1 > GetInventoryCapacity())
+void UInventoryComponent::UnindexItem(class UBaseItem* Item)
+{
+	if (FItemClassEntry* Entry = ClassIndex.Find(Item->GetClass()))
+	{
+		// RemoveSingle keeps the stacks in inventory order
+		if (Entry->Stacks.RemoveSingle(Item) > 0)
 		{
-			return FItemAddResult::AddedNone(AddAmount, LOCTEXT("InventoryCapacityFullText", "Inventory is full"));
+			Entry->TotalQuantity -= Item->GetQuantity();
+			CurrentWeight -= Item->GetStackWeight();
 		}
 
-		// This check is not implemented, character will just move slower and slower until they cannot move if too far overweight
-		// if item weight is not nearly 0, don't require a weight check
-		// if (!FMath::IsNearlyZero(Item->Weight))
-		// {
-		// 	if (GetCurrentWeight() + Item-Weight > GetWeightCapacity())
-		// 	{
-		// 		return FItemAddResult::AddedNone(AddAmount, LOCTEXT("InventoryTooMuchWeight", "Carrying too much weight"));
-		// 	}
-		// }
-
-		// !!! Looks like the video has errors in it. This code stores the item quantity trying to be added in AddAmount,
-		// but then uses it as a check for weight, but never calculates a new value. 
-		// Weight section isn't being implemented, so probably not a problem
-		
-		// if item is stackable
-		if (Item->bStackable)
+		if (Entry->Stacks.Num() == 0)
 		{
-			// check that the get quantity is less than or equal to the items max stack size
-			ensure(Item->GetQuantity() <= Item->MaxStackSize);
+			ClassIndex.Remove(Item->GetClass());
+		}
+	}
 
-			if (UBaseItem* ExistingItem = FindItem(Item))
-			{
-				if (ExistingItem->GetQuantity() < ExistingItem->MaxStackSize)
-				{
-					// find out the max amount that can fit on that stack
-					const int32 StackMaxAddAmount = ExistingItem->MaxStackSize - ExistingItem->GetQuantity();
-
-					// takes the smaller of the two, add amount of stack max add amount
-					int32 ActualAddAmount = FMath::Min(AddAmount, StackMaxAddAmount);
-
-					FText ErrorText = LOCTEXT("InventoryErrorText", "Couldnt add all of the item to your inventory");
-				
-
-					// // This check is not implemented, character will just move slower and slower until they cannot move if too far overweight
-					// if (!FMath::IsNearlyZero(Item->Weight))
-					// {
-					// 	// find out how much can fit on that stack
-					// 	const int32 WeightMaxAddAmount = FMath::FloorToInt((WeightCapacity - GetCurrentWeight()) / Item->Weight);
-
-					// 	// takes the smaller of the two, add amount of stack max add amount
-					// 	ActualAddAmount = FMath::Min(AddAmount, WeightMaxAddAmount);
-
-					// 	if (ActualAddAmount < AddAmount)
-					// 	{
-					// 		ErrorText = Ftext::Format(LOCTEXT("InventoryTooMuchWeight", "Couldn't add entire stack of {ItemName} to inventory"), Item->ItemDisplayName);
-					// 	}
-					// }
-					// // the variables being checked are an exact repeat from above, probably an error in the video
-					// else if (ActualAddAmount < AddAmount)
-					// {
-					// 	ErrorText = Ftext::Format(LOCTEXT("InventoryCapacityFullText", "Couldn't add entire stack of {ItemName} to inventory, inventory is full"), Item->ItemDisplayName);
-					// }
-
-					if (ActualAddAmount <= 0)
-					{
-						return FItemAddResult::AddedNone(AddAmount, LOCTEXT("InventoryErrorText", "Couldnt add any of the item to your inventory"));
-					}
+	// dont let float error build up once the inventory is empty
+	if (ClassIndex.Num() == 0)
+	{
+		CurrentWeight = 0.f;
+	}
+}
 
-					// updates the existing item with its currenty quantity added to the actual add amount
-					ExistingItem->SetQuantity(ExistingItem->GetQuantity() + ActualAddAmount);
+void UInventoryComponent::RefreshClassTotals(class UBaseItem* Item)
+{
+	// clients only know the new quantity, so recount the classes stacks. Almost always just the one
+	if (FItemClassEntry* Entry = ClassIndex.Find(Item->GetClass()))
+	{
+		int32 TotalQuantity = 0;
+		for (const UBaseItem* Stack : Entry->Stacks)
+		{
+			TotalQuantity += Stack->GetQuantity();
+		}
 
-					// TODO: remove this and create code to make a new stack of the item unless all capacity is taken
-					// check that the new quantity isn't greater than the max stack size of the item
-					ensure(ExistingItem->GetQuantity() <= ExistingItem->MaxStackSize);
+		CurrentWeight += (TotalQuantity - Entry->TotalQuantity) * Item->Weight;
+		Entry->TotalQuantity = TotalQuantity;
+	}
+}
 
-					// again ActualAddAmount < AddAmount is a repeat from code commented out above, this will only work for quantity not weight
-					if (ActualAddAmount < AddAmount)
-					{
-						return FItemAddResult::AddedSome(AddAmount, ActualAddAmount, ErrorText);
-					}
-					else
-					{
-						return FItemAddResult::AddedAll(AddAmount);
-					}
-				}
-				else
+void UInventoryComponent::OnItemQuantityChanged(class UBaseItem* Item, const int32 QuantityDelta)
+{
+	// items keep their owning inventory after they're removed, only count the ones still in it
+	FItemClassEntry* Entry = ClassIndex.Find(Item->GetClass());
+	if (Entry && Entry->Stacks.Contains(Item))
+	{
+		Entry->TotalQuantity += QuantityDelta;
+		CurrentWeight += QuantityDelta * Item->Weight;
+
+		// only the changed entry is sent to clients
+		if (GetOwner() && GetOwner()->HasAuthority())
+		{
+			for (FInventoryEntry& InventoryEntry : InventoryList.Entries)
+			{
+				if (InventoryEntry.Item == Item)
 				{
-					return FItemAddResult::AddedNone(AddAmount, FText::Format(LOCTEXT("InventoryFullStackSize", "{ItemName} already at max stack size"), Item->ItemDisplayName));
+					InventoryEntry.Quantity = Item->GetQuantity();
+					InventoryList.MarkItemDirty(InventoryEntry);
+					break;
 				}
 			}
-			// if item doesnt already exist in inventory, add full stack
-			else
-			{
-				AddItem(Item);
-				return FItemAddResult::AddedAll(AddAmount);
-			}
-			
+
+			// clients queue theirs when the entry arrives
+			QueueChange(Item, EInventoryChangeType::ICT_QuantityChanged);
 		}
-		// for non stacking items
-		else
-		{
-			// check for quantity of 1, add item
-			ensure(Item->GetQuantity() == 1);
-			AddItem(Item);
-			return FItemAddResult::AddedAll(AddAmount);
-		}	
 	}
+}
 
-	// second check that add item isnt being run at the client end
-	check(false);
-	return FItemAddResult::AddedNone(-1, LOCTEXT("ErrorMessage", ""));
+void UInventoryComponent::OnItemEquippedChanged(class UEquippableItem* Item)
+{
+	if (!GetOwner() || !GetOwner()->HasAuthority())
+	{
+		return;
+	}
+
+	// only the changed entry is sent to clients, EquipStatusChanged already queued the UI change
+	for (FInventoryEntry& InventoryEntry : InventoryList.Entries)
+	{
+		if (InventoryEntry.Item == Item)
+		{
+			if (InventoryEntry.bEquipped != Item->IsEquipped())
+			{
+				InventoryEntry.bEquipped = Item->IsEquipped();
+				InventoryList.MarkItemDirty(InventoryEntry);
+			}
+			break;
+		}
+	}
+}
+
+void UInventoryComponent::RunLookupBenchmark(const int32 NumLookups)
+{
+	if (!GetOwner() || !GetOwner()->HasAuthority())
+	{
+		return;
+	}
+
+	// fill every slot with the item being looked for in the last one, the worst case for a scan
+	for (int32 i = 0; i < InventoryCapacity - 1; ++i)
+	{
+		AddItem(UBaseItem::StaticClass(), 1);
+	}
+
+	AddItem(UAmmoItem::StaticClass(), 1);
+
+	const TSubclassOf<UBaseItem> TargetClass = UAmmoItem::StaticClass();
+	int32 NumFound = 0;
+
+	const double IndexStart = FPlatformTime::Seconds();
+	for (int32 i = 0; i < NumLookups; ++i)
+	{
+		NumFound += FindItemByClass(TargetClass) != nullptr;
+	}
+	const double IndexTime = FPlatformTime::Seconds() - IndexStart;
+
+	// the lookup this replaced
+	const double ScanStart = FPlatformTime::Seconds();
+	for (int32 i = 0; i < NumLookups; ++i)
+	{
+		for (UBaseItem* InvItem : InventoryArray)
+		{
+			if (InvItem && InvItem->GetClass() == TargetClass)
+			{
+				++NumFound;
+				break;
+			}
+		}
+	}
+	const double ScanTime = FPlatformTime::Seconds() - ScanStart;
+
+	UE_LOG(LogTemp, Log, TEXT("Inventory benchmark, %d items, %d lookups: class index %.3fms (%.1fns per lookup), array scan %.3fms (%.1fns per lookup), found %d"),
+		InventoryArray.Num(), NumLookups, IndexTime * 1000.0, IndexTime * 1e9 / NumLookups, ScanTime * 1000.0, ScanTime * 1e9 / NumLookups, NumFound);
+
+	// leave the inventory empty, through the same path the game removes items so the index and replicated list stay in sync
+	RemoveItems(TArray<UBaseItem*>(InventoryArray));
+}
+
+// original method, not sure if items is supposed to ref to the thing i renamed InventoryArray
+// called when items in inventory change
+// void UInventoryComponent::OnRep_Items() 
+// {
+// 	// calls the delegate to update the UI	
+// 	OnInventoryUpdated.Broadcast();
+
+// 	for (auto& Item : InventoryArray)
+// 	{
+// 		//On the client the world won't be set initially, so it set if not
+// 		if (!Item->World)
+// 		{
+// 			OnItemAdded.Broadcast(Item);
+// 			Item->World = GetWorld();
+// 		}
+// 	}
+// }
+
+UBaseItem* UInventoryComponent::AddItem(TSubclassOf<class UBaseItem> ItemClass, const int32 Quantity)
+{
+	// Check to force the server to add the item, not the client. Prevents cheating or improper added of items client side
+	// !!! GetOwner()->HasAuthority() didnt work when previously implemented on character? !!!
+	if(GetOwner() && GetOwner()->HasAuthority())
+	{
+		// creates the stack from the item class, owned by the current player and added to inventory
+		UBaseItem* NewItem = NewObject<UBaseItem>(GetOwner(), ItemClass);
+		NewItem->World = GetWorld();
+		NewItem->SetQuantity(Quantity);
+		NewItem->OwningInventory = this;
+		NewItem->AddedToInventory(this);
+		InventoryArray.Add(NewItem);
+		IndexItem(NewItem);
+
+		// the entry tells clients about the item, the item itself is sent once as a subobject
+		FInventoryEntry& Entry = InventoryList.Entries.AddDefaulted_GetRef();
+		Entry.Item = NewItem;
+		Entry.Quantity = NewItem->GetQuantity();
+
+		// AddedToInventory may have equipped the item before it had an entry
+		const UEquippableItem* Equippable = Cast<UEquippableItem>(NewItem);
+		Entry.bEquipped = Equippable && Equippable->IsEquipped();
+		InventoryList.MarkItemDirty(Entry);
+		ReplicatedItemsKey++;
+
+		NewItem->MarkDirtyForReplication();
+		//OnItemAdded.Broadcast(NewItem);
+
+		// tells the UI to update
+		QueueChange(NewItem, EInventoryChangeType::ICT_Added);
+
+
+		return NewItem;
+	}
+
+	// if the server isnt the one calling add item, return null
+	return nullptr;
+}
+
+FItemAddResult UInventoryComponent::TryAddItem_Internal(const FItemInstance& Instance) 
+{
+	if (GetOwner() && GetOwner()->HasAuthority())
+	{
+		// a single add is a batch of one
+		return TryAddItems({ Instance })[0];
+	}
+
+	// second check that add item isnt being run at the client end
+	check(false);
+	return FItemAddResult::AddedNone(-1, LOCTEXT("ErrorMessage", ""));
+}
+
+TArray<FItemAddResult> UInventoryComponent::TryAddItems(const TArray<FItemInstance>& Instances)
+{
+	TArray<FItemAddResult> Results;
+	Results.Reserve(Instances.Num());
+
+	// only the server adds items
+	if (!GetOwner() || !GetOwner()->HasAuthority())
+	{
+		for (const FItemInstance& Instance : Instances)
+		{
+			Results.Add(FItemAddResult::AddedNone(Instance.Quantity, LOCTEXT("ErrorMessage", "")));
+		}
+		return Results;
+	}
+
+	// what every touched stack will hold once the batch is committed, existing stacks have Item set
+	struct FPlannedStack
+	{
+		UBaseItem* Item;
+		TSubclassOf<UBaseItem> ItemClass;
+		int32 Quantity;
+	};
+	TArray<FPlannedStack> PlannedStacks;
+	TSet<UClass*> PlannedClasses;
+
+	// slots and weight left as the plan fills them
+	int32 FreeSlots = GetInventoryCapacity() - InventoryArray.Num();
+	float PlannedWeight = CurrentWeight;
+
+	for (const FItemInstance& Instance : Instances)
+	{
+		// static data is read from the definition, the instance only carries the class and quantity
+		const UBaseItem* Item = Instance.GetDefinition();
+		const int32 AddAmount = Instance.Quantity;
+		if (!Item || AddAmount <= 0)
+		{
+			Results.Add(FItemAddResult::AddedNone(AddAmount, LOCTEXT("InventoryInvalidItem", "Couldnt add an invalid item to your inventory")));
+			continue;
+		}
+
+		// only as many as can be carried
+		const int32 WeightMaxAddAmount = GetWeightMaxAddAmount(Item, PlannedWeight);
+		const int32 PlaceAmount = FMath::Min(AddAmount, WeightMaxAddAmount);
+		const int32 StackSize = Item->bStackable ? FMath::Max(Item->MaxStackSize, 1) : 1;
+		int32 Placed = 0;
+
+		if (Item->bStackable && PlaceAmount > 0)
+		{
+			// the classes existing stacks join the plan the first time the class is seen
+			if (!PlannedClasses.Contains(Instance.ItemClass))
+			{
+				PlannedClasses.Add(Instance.ItemClass);
+				if (const FItemClassEntry* Entry = ClassIndex.Find(Instance.ItemClass))
+				{
+					for (UBaseItem* Stack : Entry->Stacks)
+					{
+						PlannedStacks.Add({ Stack, Instance.ItemClass, Stack->GetQuantity() });
+					}
+				}
+			}
+
+			// top up every partial stack of the class, existing ones first then ones planned earlier in the batch
+			for (FPlannedStack& PlannedStack : PlannedStacks)
+			{
+				if (Placed >= PlaceAmount)
+				{
+					break;
+				}
+
+				if (PlannedStack.ItemClass == Instance.ItemClass && PlannedStack.Quantity < StackSize)
+				{
+					const int32 StackAddAmount = FMath::Min(StackSize - PlannedStack.Quantity, PlaceAmount - Placed);
+					PlannedStack.Quantity += StackAddAmount;
+					Placed += StackAddAmount;
+				}
+			}
+		}
+
+		// whatever is left goes into new stacks while there are free slots
+		while (Placed < PlaceAmount && FreeSlots > 0)
+		{
+			const int32 StackAddAmount = FMath::Min(StackSize, PlaceAmount - Placed);
+			PlannedStacks.Add({ nullptr, Instance.ItemClass, StackAddAmount });
+			Placed += StackAddAmount;
+			--FreeSlots;
+		}
+
+		PlannedWeight += Placed * Item->Weight;
+
+		if (Placed >= AddAmount)
+		{
+			Results.Add(FItemAddResult::AddedAll(AddAmount));
+		}
+		else if (Placed < PlaceAmount)
+		{
+			// ran out of slots before weight
+			const FText ErrorText = LOCTEXT("InventoryCapacityFullText", "Inventory is full");
+			Results.Add(Placed > 0 ? FItemAddResult::AddedSome(AddAmount, Placed, ErrorText) : FItemAddResult::AddedNone(AddAmount, ErrorText));
+		}
+		else if (Placed > 0)
+		{
+			Results.Add(FItemAddResult::AddedSome(AddAmount, Placed, FText::Format(LOCTEXT("InventoryStackTooMuchWeight", "Couldn't add entire stack of {ItemName} to inventory, carrying too much weight"), Item->ItemDisplayName)));
+		}
+		else
+		{
+			Results.Add(FItemAddResult::AddedNone(AddAmount, LOCTEXT("InventoryTooMuchWeight", "Carrying too much weight")));
+		}
+	}
+
+	// commit, existing stacks only change their entry and new ones are created once with their final quantity
+	for (const FPlannedStack& PlannedStack : PlannedStacks)
+	{
+		if (!PlannedStack.Item)
+		{
+			AddItem(PlannedStack.ItemClass, PlannedStack.Quantity);
+		}
+		else if (PlannedStack.Item->GetQuantity() != PlannedStack.Quantity)
+		{
+			PlannedStack.Item->SetQuantity(PlannedStack.Quantity);
+		}
+	}
+
+	return Results;
+}
+
+int32 UInventoryComponent::GetWeightMaxAddAmount(const class UBaseItem* Item, const float UsedWeight) const
+{
+	// weightless items and inventories without a weight capacity take anything
+	if (FMath::IsNearlyZero(Item->Weight) || WeightCapacity <= 0.f)
+	{
+		return MAX_int32;
+	}
+
+	return FMath::Max(FMath::FloorToInt((WeightCapacity - UsedWeight) / Item->Weight), 0);
+}
+
+void UInventoryComponent::SaveSnapshot(TArray<uint8>& OutData) const
+{
+	OutData.Reset();
+	FMemoryWriter Writer(OutData);
+
+	uint32 Magic = InventorySnapshotMagic;
+	uint8 Version = InventorySnapshotVersion;
+	Writer << Magic;
+	Writer << Version;
+
+	// each class is written once, stacks refer to it by index
+	TArray<UClass*, TInlineAllocator<32>> Classes;
+	TArray<uint32, TInlineAllocator<64>> StackClassIndices;
+	for (const UBaseItem* Item : InventoryArray)
+	{
+		StackClassIndices.Add(Classes.AddUnique(Item->GetClass()));
+	}
+
+	uint32 NumClasses = Classes.Num();
+	Writer.SerializeIntPacked(NumClasses);
+	for (UClass* Class : Classes)
+	{
+		FString ClassPath = Class->GetPathName();
+		Writer << ClassPath;
+	}
+
+	// stacks in inventory order, packed ints so most stacks are three bytes
+	uint32 NumStacks = InventoryArray.Num();
+	Writer.SerializeIntPacked(NumStacks);
+	for (int32 i = 0; i < InventoryArray.Num(); ++i)
+	{
+		const UBaseItem* Item = InventoryArray[i];
+		const UEquippableItem* Equippable = Cast<UEquippableItem>(Item);
+
+		uint32 Quantity = FMath::Max(Item->GetQuantity(), 0);
+		uint8 Flags = Equippable && Equippable->IsEquipped() ? ISF_Equipped : 0;
+
+		Writer.SerializeIntPacked(StackClassIndices[i]);
+		Writer.SerializeIntPacked(Quantity);
+		Writer << Flags;
+	}
+}
+
+bool UInventoryComponent::LoadSnapshot(const TArray<uint8>& Data)
+{
+	if (!GetOwner() || !GetOwner()->HasAuthority())
+	{
+		return false;
+	}
+
+	FMemoryReader Reader(Data);
+
+	uint32 Magic = 0;
+	uint8 Version = 0;
+	Reader << Magic;
+	Reader << Version;
+	if (Reader.IsError() || Magic != InventorySnapshotMagic || Version == 0 || Version > InventorySnapshotVersion)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Inventory snapshot for %s isn't a snapshot or is from a newer version"), *GetNameSafe(GetOwner()));
+		return false;
+	}
+
+	// every class or stack takes at least a byte, so larger counts can only come from a corrupt snapshot
+	uint32 NumClasses = 0;
+	Reader.SerializeIntPacked(NumClasses);
+	if (Reader.IsError() || NumClasses > (uint32)Data.Num())
+	{
+		return false;
+	}
+
+	// items that have been removed from the game since the snapshot was taken resolve to null and are dropped
+	TArray<UClass*, TInlineAllocator<32>> Classes;
+	Classes.Reserve(NumClasses);
+	for (uint32 i = 0; i < NumClasses; ++i)
+	{
+		if (!IsStringLengthInBounds(Reader))
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Inventory snapshot for %s has a class path longer than the snapshot"), *GetNameSafe(GetOwner()));
+			return false;
+		}
+
+		FString ClassPath;
+		Reader << ClassPath;
+		Classes.Add(FSoftClassPath(ClassPath).TryLoadClass<UBaseItem>());
+	}
+
+	uint32 NumStacks = 0;
+	Reader.SerializeIntPacked(NumStacks);
+	if (Reader.IsError() || NumStacks > (uint32)Data.Num())
+	{
+		return false;
+	}
+
+	struct FSnapshotStack
+	{
+		UClass* ItemClass;
+		int32 Quantity;
+		bool bEquipped;
+	};
+	TArray<FSnapshotStack> Stacks;
+	Stacks.Reserve(NumStacks);
+
+	for (uint32 i = 0; i < NumStacks; ++i)
+	{
+		uint32 ClassIndex = 0;
+		uint32 Quantity = 0;
+		uint8 Flags = 0;
+		Reader.SerializeIntPacked(ClassIndex);
+		Reader.SerializeIntPacked(Quantity);
+		Reader << Flags;
+
+		if (Reader.IsError() || ClassIndex >= NumClasses)
+		{
+			return false;
+		}
+
+		if (Classes[ClassIndex] && Quantity > 0)
+		{
+			Stacks.Add({ Classes[ClassIndex], (int32)FMath::Min<uint32>(Quantity, MAX_int32), (Flags & ISF_Equipped) != 0 });
+		}
+	}
+
+	// the snapshot is good, swap the contents over
+	RemoveItems(TArray<UBaseItem*>(InventoryArray));
+
+	const int32 NumToAdd = FMath::Min(Stacks.Num(), GetInventoryCapacity());
+	InventoryArray.Reserve(NumToAdd);
+	InventoryList.Entries.Reserve(NumToAdd);
+
+	for (int32 i = 0; i < NumToAdd; ++i)
+	{
+		const FSnapshotStack& Stack = Stacks[i];
+		UBaseItem* Item = AddItem(Stack.ItemClass, Stack.Quantity);
+
+		// gear can equip itself when it's added, so only change it if it doesn't match the snapshot
+		if (UEquippableItem* Equippable = Cast<UEquippableItem>(Item))
+		{
+			if (Equippable->IsEquipped() != Stack.bEquipped)
+			{
+				Equippable->SetEquipped(Stack.bEquipped);
+			}
+		}
+	}
+
+	return true;
+}
+
+void UInventoryComponent::RunSnapshotBenchmark(const int32 Iterations)
+{
+	if (!GetOwner() || !GetOwner()->HasAuthority())
+	{
+		return;
+	}
+
+	// fill every slot with a mix of classes and quantities
+	for (int32 i = 0; i < InventoryCapacity; ++i)
+	{
+		AddItem(i % 2 ? UAmmoItem::StaticClass() : UBaseItem::StaticClass(), 1 + i % 50);
+	}
+
+	TArray<uint8> Data;
+
+	const double SaveStart = FPlatformTime::Seconds();
+	for (int32 i = 0; i < Iterations; ++i)
+	{
+		SaveSnapshot(Data);
+	}
+	const double SaveTime = FPlatformTime::Seconds() - SaveStart;
+
+	// loading includes creating every stack, which is most of the cost
+	int32 NumLoaded = 0;
+	const double LoadStart = FPlatformTime::Seconds();
+	for (int32 i = 0; i < Iterations; ++i)
+	{
+		NumLoaded += LoadSnapshot(Data);
+	}
+	const double LoadTime = FPlatformTime::Seconds() - LoadStart;
+
+	const double TotalMB = (double)Data.Num() * Iterations / (1024.0 * 1024.0);
+	UE_LOG(LogTemp, Log, TEXT("Inventory snapshot benchmark, %d stacks, %d bytes, %d iterations: save %.1fus per snapshot (%.1fMB/s), load %.1fus per snapshot (%.1fMB/s), loaded %d"),
+		InventoryArray.Num(), Data.Num(), Iterations, SaveTime * 1e6 / Iterations, TotalMB / FMath::Max(SaveTime, 1e-9), LoadTime * 1e6 / Iterations, TotalMB / FMath::Max(LoadTime, 1e-9), NumLoaded);
+
+	// leave the inventory empty
+	RemoveItems(TArray<UBaseItem*>(InventoryArray));
+}
+
+void UInventoryComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (!JournalKey.IsNone())
+	{
+		if (UTrolledGameInstance* GameInstance = GetWorld() ? GetWorld()->GetGameInstance<UTrolledGameInstance>() : nullptr)
+		{
+			GameInstance->UntrackInventory(JournalKey, this);
+		}
+		JournalKey = NAME_None;
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void UInventoryComponent::SetJournalKey(const FName Key)
+{
+	JournalKey = Key;
+
+	if (!JournalKey.IsNone() && GetOwner() && GetOwner()->HasAuthority())
+	{
+		for (const TPair<UClass*, FItemClassEntry>& Pair : ClassIndex)
+		{
+			JournalClass(Pair.Key);
+		}
+	}
+}
+
+void UInventoryComponent::JournalClass(UClass* ItemClass)
+{
+	UTrolledGameInstance* GameInstance = GetWorld() ? GetWorld()->GetGameInstance<UTrolledGameInstance>() : nullptr;
+	if (!GameInstance || !ItemClass)
+	{
+		return;
+	}
+
+	// equipped if any stack of the class is, gear only ever has the one
+	bool bEquipped = false;
+	if (const FItemClassEntry* Entry = ClassIndex.Find(ItemClass))
+	{
+		for (const UBaseItem* Stack : Entry->Stacks)
+		{
+			const UEquippableItem* Equippable = Cast<UEquippableItem>(Stack);
+			bEquipped |= Equippable && Equippable->IsEquipped();
+		}
+	}
+
+	GameInstance->JournalInventoryClass(JournalKey, ItemClass, GetItemQuantity(ItemClass), bEquipped);
+}
+
+void UInventoryComponent::ApplyJournalState(const FInventoryJournalState& State)
+{
+	if (!GetOwner() || !GetOwner()->HasAuthority())
+	{
+		return;
+	}
+
+	// the journal has the full contents, nothing from before counts
+	if (State.bComplete)
+	{
+		RemoveItems(TArray<UBaseItem*>(InventoryArray));
+	}
+
+	TArray<FItemInstance> ItemsToAdd;
+	for (const TPair<FName, FInventoryJournalClassState>& Pair : State.Classes)
+	{
+		UClass* ItemClass = FSoftClassPath(Pair.Key.ToString()).TryLoadClass<UBaseItem>();
+		if (!ItemClass)
+		{
+			continue;
+		}
+
+		const int32 CurrentQuantity = GetItemQuantity(ItemClass);
+		if (Pair.Value.Quantity > CurrentQuantity)
+		{
+			ItemsToAdd.Add(FItemInstance(ItemClass, Pair.Value.Quantity - CurrentQuantity));
+		}
+		else if (Pair.Value.Quantity < CurrentQuantity)
+		{
+			// take from the last stacks first
+			TArray<UBaseItem*> Stacks(ClassIndex.FindChecked(ItemClass).Stacks);
+			int32 RemoveQuantity = CurrentQuantity - Pair.Value.Quantity;
+			for (int32 i = Stacks.Num() - 1; i >= 0 && RemoveQuantity > 0; --i)
+			{
+				RemoveQuantity -= ConsumeQuantity(Stacks[i], RemoveQuantity);
+			}
+		}
+	}
+
+	// new stacks are planned together like any other bulk add
+	TryAddItems(ItemsToAdd);
+
+	for (const TPair<FName, FInventoryJournalClassState>& Pair : State.Classes)
+	{
+		UClass* ItemClass = FSoftClassPath(Pair.Key.ToString()).TryLoadClass<UBaseItem>();
+		if (UEquippableItem* Equippable = Cast<UEquippableItem>(FindItemByClass(ItemClass)))
+		{
+			if (Equippable->IsEquipped() != Pair.Value.bEquipped)
+			{
+				Equippable->SetEquipped(Pair.Value.bEquipped);
+			}
+		}
+	}
+}
+
+void UInventoryComponent::AddLooter(class UInventoryComponent* LooterInventory)
+{
+	if (!LooterInventory || LooterInventory == this || !GetOwner() || !GetOwner()->HasAuthority())
+	{
+		return;
+	}
+
+	// a looter playing on the server already sees the real contents
+	if (!LooterInventory->GetOwner() || !LooterInventory->GetOwner()->GetNetConnection())
+	{
+		return;
+	}
+
+	Looters.AddUnique(LooterInventory);
+	LooterInventory->SyncLootList(this);
+
+	// send the items now rather than at the next net update
+	GetOwner()->ForceNetUpdate();
+}
+
+void UInventoryComponent::RemoveLooter(class UInventoryComponent* LooterInventory)
+{
+	if (LooterInventory && Looters.Remove(LooterInventory) > 0)
+	{
+		// the looter drops the contents, they stop being sent until it opens the inventory again
+		LooterInventory->SyncLootList(nullptr);
+	}
+}
+
+bool UInventoryComponent::IsLootedBy(const class UNetConnection* Connection) const
+{
+	for (const TWeakObjectPtr<UInventoryComponent>& Looter : Looters)
+	{
+		if (Looter.IsValid() && Looter->GetOwner() && Looter->GetOwner()->GetNetConnection() == Connection)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void UInventoryComponent::SyncLootList(const UInventoryComponent* Source)
+{
+	// entries for items that have left the source
+	const int32 NumRemoved = LootList.Entries.RemoveAllSwap([Source](const FInventoryEntry& Entry)
+	{
+		return !Source || !Source->InventoryArray.Contains(Entry.Item);
+	});
+
+	if (NumRemoved > 0)
+	{
+		LootList.MarkArrayDirty();
+	}
+
+	if (!Source)
+	{
+		return;
+	}
+
+	TMap<UBaseItem*, int32, TInlineSetAllocator<64>> LootIndices;
+	for (int32 i = 0; i < LootList.Entries.Num(); ++i)
+	{
+		LootIndices.Add(LootList.Entries[i].Item, i);
+	}
+
+	// only new or changed entries are marked, the rest of the list isn't sent again
+	for (const FInventoryEntry& SourceEntry : Source->InventoryList.Entries)
+	{
+		if (const int32* LootIndex = LootIndices.Find(SourceEntry.Item))
+		{
+			FInventoryEntry& LootEntry = LootList.Entries[*LootIndex];
+			if (LootEntry.Quantity != SourceEntry.Quantity || LootEntry.bEquipped != SourceEntry.bEquipped)
+			{
+				LootEntry.Quantity = SourceEntry.Quantity;
+				LootEntry.bEquipped = SourceEntry.bEquipped;
+				LootList.MarkItemDirty(LootEntry);
+			}
+		}
+		else
+		{
+			FInventoryEntry& LootEntry = LootList.Entries.AddDefaulted_GetRef();
+			LootEntry.Item = SourceEntry.Item;
+			LootEntry.Quantity = SourceEntry.Quantity;
+			LootEntry.bEquipped = SourceEntry.bEquipped;
+			LootList.MarkItemDirty(LootEntry);
+		}
+	}
+}
+
+void UInventoryComponent::SetLootedInventory(class UInventoryComponent* LootedInventory)
+{
+	if (GetOwnerRole() == ROLE_Authority)
+	{
+		return;
+	}
+
+	// entries that arrived before the loot source did may have gone to the old inventory, so it is emptied either way
+	if (LootList.OwnerInventory && LootList.OwnerInventory != this)
+	{
+		LootList.OwnerInventory->ClearReplicatedContents();
+	}
+
+	LootList.OwnerInventory = LootedInventory != this ? LootedInventory : nullptr;
+
+	// fill the looted inventory from what has already arrived
+	if (LootList.OwnerInventory)
+	{
+		LootList.OwnerInventory->ClearReplicatedContents();
+		for (const FInventoryEntry& Entry : LootList.Entries)
+		{
+			LootList.OwnerInventory->OnEntryAdded(Entry);
+		}
+	}
+}
+
+void UInventoryComponent::ClearReplicatedContents()
+{
+	if (GetOwnerRole() == ROLE_Authority)
+	{
+		return;
+	}
+
+	for (UBaseItem* Item : InventoryArray)
+	{
+		if (Item)
+		{
+			UnindexItem(Item);
+			QueueChange(Item, EInventoryChangeType::ICT_Removed);
+		}
+	}
+	InventoryArray.Reset();
 }
 
-#undef LOCTEXT_NAMESPACE
\ No newline at end of file
+#undef LOCTEXT_NAMESPACE
@@ -5,11 +5,46 @@
 #include "CoreMinimal.h"
 #include "Trolled/Items/BaseItem.h"
 #include "Components/ActorComponent.h"
+#include "Engine/NetSerialization.h"
 #include "InventoryComponent.generated.h"
 
 // Delegate used to update the inventory UI anytime items are modified
 DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnInventoryUpdated);
 
+// what happened to an item in the inventory
+UENUM(BlueprintType)
+enum class EInventoryChangeType : uint8
+{
+	ICT_Added UMETA(DisplayName = "Added"),
+	ICT_Removed UMETA(DisplayName = "Removed"),
+	ICT_QuantityChanged UMETA(DisplayName = "Quantity changed"),
+	ICT_EquippedChanged UMETA(DisplayName = "Equipped changed")
+};
+
+// a single item change, lets the UI update one slot instead of rebuilding
+USTRUCT(BlueprintType)
+struct FInventoryChange
+{
+	GENERATED_BODY()
+
+	FInventoryChange()
+	{
+		Item = nullptr;
+		ChangeType = EInventoryChangeType::ICT_Added;
+	}
+
+	FInventoryChange(class UBaseItem* InItem, const EInventoryChangeType InChangeType) : Item(InItem), ChangeType(InChangeType) {};
+
+	UPROPERTY(BlueprintReadOnly, Category = "Inventory")
+	class UBaseItem* Item;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Inventory")
+	EInventoryChangeType ChangeType;
+};
+
+// Delegate with every item change since the last broadcast, at most once per frame
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnInventoryChanged, const TArray<FInventoryChange>&, Changes);
+
 // enum for selecting if the add item operation was not, partially or fully successful
 UENUM(BlueprintType)
 enum class EItemAddResult : uint8
@@ -82,6 +117,65 @@ public:
 
 };
 
+// one item in an inventory, the per stack state (quantity, equipped) replicates here so a stack changing only sends its own entry
+// stacks in an inventory are item objects as the inventory UI and Use/Equip work on them, items outside inventories are FItemInstance
+USTRUCT()
+struct FInventoryEntry : public FFastArraySerializerItem
+{
+	GENERATED_BODY()
+
+	FInventoryEntry()
+	{
+		Item = nullptr;
+		Quantity = 0;
+		bEquipped = false;
+	}
+
+	// the item, replicated once as a subobject of the inventory
+	UPROPERTY()
+	class UBaseItem* Item;
+
+	// server copy of the items quantity
+	UPROPERTY()
+	int32 Quantity;
+
+	// server copy of the items equip state, only used by equippables
+	UPROPERTY()
+	bool bEquipped;
+
+	// client callbacks, passed on to the owning inventory
+	void PreReplicatedRemove(const struct FInventoryList& InArraySerializer);
+	void PostReplicatedAdd(const struct FInventoryList& InArraySerializer);
+	void PostReplicatedChange(const struct FInventoryList& InArraySerializer);
+};
+
+// replicated contents of an inventory, only added, changed and removed entries are sent
+USTRUCT()
+struct FInventoryList : public FFastArraySerializer
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TArray<FInventoryEntry> Entries;
+
+	// inventory the list belongs to, set in its constructor
+	class UInventoryComponent* OwnerInventory = nullptr;
+
+	bool NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms)
+	{
+		return FFastArraySerializer::FastArrayDeltaSerialize<FInventoryEntry, FInventoryList>(Entries, DeltaParms, *this);
+	}
+};
+
+template<>
+struct TStructOpsTypeTraits<FInventoryList> : public TStructOpsTypeTraitsBase2<FInventoryList>
+{
+	enum
+	{
+		WithNetDeltaSerializer = true
+	};
+};
+
 UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
 class TROLLED_API UInventoryComponent : public UActorComponent
 {
@@ -89,6 +183,8 @@ class TROLLED_API UInventoryComponent : public UActorComponent
 
 	// allows base item to access private functions inside of inventory component
 	friend class UBaseItem;
+	friend class UEquippableItem;
+	friend struct FInventoryEntry;
 
 public:	
 	// Sets default values for this component's properties
@@ -106,6 +202,17 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Inventory")
 	FItemAddResult TryAddItemFromClass(TSubclassOf<class UBaseItem> ItemClass, const int32 Quantity = 1);
 
+	/** Add an item instance to inventory, used by pickups so no item object is needed until the item is actually stored
+	 * @return the amount of the item that was added to the inventory */
+	UFUNCTION(BlueprintCallable, Category = "Inventory")
+	FItemAddResult TryAddItemInstance(const FItemInstance& Instance);
+
+	/** Add several items in one go. Stack merges, new slots and weight for the whole list are planned first, filling every
+	 * partial stack of a class before using a new slot, then the plan is committed so each stack is only touched once
+	 * @return one result per instance, in the same order */
+	UFUNCTION(BlueprintCallable, Category = "Inventory")
+	TArray<FItemAddResult> TryAddItems(const TArray<FItemInstance>& Instances);
+
 	// removes all or some quantity away from an item or the item itself when quantity reaches 0.
 	int32 ConsumeAll(class UBaseItem* Item);
 	int32 ConsumeQuantity(class UBaseItem* Item, const int32 Quantity);
@@ -114,12 +221,26 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Inventory")
 	bool RemoveItem(class UBaseItem* Item);
 
+	/** [server] Move stacks from this inventory into another one. Placement of every stack is resolved first, then the
+	 * moved quantities are taken out of this inventory in one pass with one replication update and one UI refresh per inventory
+	 * @param Items stacks in this inventory to move, anything not in this inventory is skipped
+	 * @param OutErrorText why the last stack couldn't be fully moved, empty if everything was moved
+	 * @return the total quantity moved */
+	int32 TransferItems(class UInventoryComponent* Destination, const TArray<class UBaseItem*>& Items, FText& OutErrorText);
+
+	// [server] moves every stack in this inventory that fits into another one
+	int32 TransferAllItems(class UInventoryComponent* Destination, FText& OutErrorText);
+
 
 	// item search functions
 	// return true if player has a given amount of an item
 	UFUNCTION(BlueprintPure, Category = "Inventory")
 	bool HasItemQuantity(TSubclassOf <class UBaseItem> ItemClass, const int32 Quantity = 1) const;
 
+	// return the total quantity of an item class across all of its stacks
+	UFUNCTION(BlueprintPure, Category = "Inventory")
+	int32 GetItemQuantity(TSubclassOf <class UBaseItem> ItemClass) const;
+
 	// return first item with the same class as a given item
 	UFUNCTION(BlueprintPure, Category = "Inventory")
 	UBaseItem* FindItem(class UBaseItem* Item) const;
@@ -157,23 +278,61 @@ public:
 	UFUNCTION(BlueprintPure, Category = "Inventory")
 	FORCEINLINE TArray<class UBaseItem*> GetItems() const { return InventoryArray; };
 
-	// forces client to refresh inventory
-	UFUNCTION(Client, Reliable)
-	void ClientRefreshInventory();
-
+	// broadcast once per frame after any change, including capacity changes. Bind OnInventoryChanged to only update what changed
 	UPROPERTY(BlueprintAssignable, Category = "Inventory")
 	FOnInventoryUpdated OnInventoryUpdated;
 
+	// broadcast once per frame with the item changes made that frame, just before OnInventoryUpdated
+	UPROPERTY(BlueprintAssignable, Category = "Inventory")
+	FOnInventoryChanged OnInventoryChanged;
+
+	// [server] fills the inventory to its max capacity and times NumLookups class lookups against a scan of InventoryArray. Removes every item
+	void RunLookupBenchmark(const int32 NumLookups);
+
+	/** Write the inventory to a compact, versioned binary snapshot. Only the class, quantity and equipped state of each stack are stored
+	 * @param OutData replaced with the snapshot */
+	void SaveSnapshot(TArray<uint8>& OutData) const;
+
+	/** [server] Replace the contents of the inventory with a snapshot from SaveSnapshot. The whole snapshot is read before anything
+	 * changes, then each stack is created once with its saved quantity. Weight isn't checked as the snapshot was valid when saved
+	 * @return false if the snapshot couldn't be read, the inventory is left as it was */
+	bool LoadSnapshot(const TArray<uint8>& Data);
+
+	// [server] fills the inventory to its max capacity and times Iterations saves and loads of its snapshot. Removes every item
+	void RunSnapshotBenchmark(const int32 Iterations);
+
+	// [server] journal every change under Key from now on, starting with the full contents. Set by the game instance
+	void SetJournalKey(const FName Key);
+
+	// [server] sets each journaled item class to its journaled quantity and equipped state, emptying the inventory first for a complete journal
+	void ApplyJournalState(const struct FInventoryJournalState& State);
+
+	// [server] a player inventory starts or stops looting this one. Contents are only sent to the owner and to looters,
+	// through the looters LootList, so containers nobody has open cost no bandwidth
+	void AddLooter(class UInventoryComponent* LooterInventory);
+	void RemoveLooter(class UInventoryComponent* LooterInventory);
+
+	// [client] the inventory being looted, LootList entries are applied to it. The old one is emptied as its contents stop replicating
+	void SetLootedInventory(class UInventoryComponent* LootedInventory);
+
 protected:
-	// array for the current inventory, replicated to server
-	UPROPERTY(ReplicatedUsing = OnRep_InventoryArray, VisibleAnywhere, Category = "Inventory")
+	// array for the current inventory, built from InventoryList on clients
+	UPROPERTY(Transient, VisibleAnywhere, Category = "Inventory")
 	TArray<class UBaseItem*> InventoryArray;
 
+	// replicated contents of the inventory, sent as deltas. Owner only, looters get them through LootList
+	UPROPERTY(Replicated)
+	FInventoryList InventoryList;
+
+	// [owner] copy of the contents of the inventory this player is looting, with its own entry ids
+	UPROPERTY(Replicated)
+	FInventoryList LootList;
+
 	// total inventory slots, increased with bags
 	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Inventory", meta = (ClampMin = 0, ClampMax = 200))
 	int32 InventoryCapacity;
 
-	// weight capacity
+	// weight capacity, items that would go over it are only partly added. 0 for no limit
 	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Inventory")
 	float WeightCapacity;
 
@@ -181,24 +340,96 @@ protected:
 	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
 	virtual bool ReplicateSubobjects(class UActorChannel *Channel, class FOutBunch *Bunch, FReplicationFlags *RepFlags);
 
+	// hands the last state of a journaled inventory back to the game instance
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 
 private:
 
 	// Dont call InventoryArray.Add() directly, use this function as it handles ownership and replication
-	UBaseItem* AddItem(class UBaseItem* Item);
+	// creates a stack of the item class with the given quantity
+	UBaseItem* AddItem(TSubclassOf<class UBaseItem> ItemClass, const int32 Quantity);
+
+	// removes several stacks with a single InventoryList update
+	void RemoveItems(const TArray<class UBaseItem*>& Items);
+
+	// [server] player inventories looting this one, their LootList is synced after every change
+	TArray<TWeakObjectPtr<UInventoryComponent>> Looters;
+
+	// [server] makes LootList match the contents of Source, or empties it
+	void SyncLootList(const UInventoryComponent* Source);
+
+	// true if the connection belongs to one of the looters
+	bool IsLootedBy(const class UNetConnection* Connection) const;
+
+	// [client] empties contents that stopped replicating, used when looting ends
+	void ClearReplicatedContents();
+
+	// key the inventory is journaled under, none if it isn't persisted
+	FName JournalKey;
+
+	// [server] journals the current quantity and equipped state of an item class
+	void JournalClass(UClass* ItemClass);
+
+	// item changes waiting for the next broadcast
+	TArray<FInventoryChange> PendingChanges;
+	bool bBroadcastPending = false;
+
+	// records a change for the next broadcast. An item added this frame only reports the add, and one removed only reports the removal
+	void QueueChange(class UBaseItem* Item, const EInventoryChangeType ChangeType);
+
+	// schedules OnInventoryChanged and OnInventoryUpdated for the next tick if they aren't already
+	void QueueBroadcast();
 
-	// used to refresh UI when items gained, used, equipped, etc
-	UFUNCTION()
-	void OnRep_InventoryArray();
-	// original function
-	//void OnRep_Items();
+	// sends the pending changes
+	void BroadcastChanges();
 
-	// used to control when an item needs to be replicated
+	// [client] InventoryList callbacks, keep InventoryArray and the class index in sync and refresh the UI
+	void OnEntryAdded(const FInventoryEntry& Entry);
+	void OnEntryChanged(const FInventoryEntry& Entry);
+	void OnEntryRemoved(const FInventoryEntry& Entry);
+
+	// used to control when an item needs to be replicated, changes when an item is added or one of its own properties changes
 	UPROPERTY()
 	int32 ReplicatedItemsKey;
 
-	// Internal, non-BP exposed add item function. Not used directly, call TryAddItem() or TryAddItemFromClass()
-	FItemAddResult TryAddItem_Internal(class UBaseItem* Item);
+	// Internal, non-BP exposed add item function. Not used directly, call TryAddItem(), TryAddItemFromClass() or TryAddItemInstance()
+	// goes through TryAddItems, stack size, weight and name come from the item definition so nothing is created unless a new stack is needed
+	FItemAddResult TryAddItem_Internal(const FItemInstance& Instance);
+
+	// stacks of one item class in inventory order, and their total quantity
+	struct FItemClassEntry
+	{
+		TArray<UBaseItem*, TInlineAllocator<1>> Stacks;
+		int32 TotalQuantity = 0;
+	};
+
+	// InventoryArray indexed by exact item class, so class lookups dont scan the inventory
+	// kept up to date on add, remove and quantity change, on clients from the InventoryList callbacks
+	// items are kept alive by InventoryArray
+	TMap<UClass*, FItemClassEntry> ClassIndex;
+
+	// add or remove an item from ClassIndex
+	void IndexItem(class UBaseItem* Item);
+	void UnindexItem(class UBaseItem* Item);
+
+	// [client] recounts the total quantity and weight of a class after one of its stacks was replicated
+	void RefreshClassTotals(class UBaseItem* Item);
+
+	// total weight of every stack, updated with ClassIndex so weight checks dont walk the inventory
+	float CurrentWeight = 0.f;
+
+	// how many of an item fit in the weight capacity left after UsedWeight
+	int32 GetWeightMaxAddAmount(const class UBaseItem* Item, const float UsedWeight) const;
+
+	// called by items in this inventory when their quantity changes
+	void OnItemQuantityChanged(class UBaseItem* Item, const int32 QuantityDelta);
+
+	// [server] called by equippables in this inventory when they are equipped or unequipped
+	void OnItemEquippedChanged(class UEquippableItem* Item);
+
+	// [client] applies the equip state from a replicated entry to its item
+	void ApplyEntryEquipped(class UBaseItem* Item, const FInventoryEntry& Entry);
 	
 		
 };
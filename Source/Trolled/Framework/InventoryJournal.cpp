@@ -0,0 +1,341 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "InventoryJournal.h"
+#include "HAL/RunnableThread.h"
+#include "HAL/PlatformFilemanager.h"
+#include "HAL/PlatformProcess.h"
+#include "GenericPlatform/GenericPlatformFile.h"
+#include "Misc/FileHelper.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "Trolled/Trolled.h"
+
+// first bytes of the journal file, "TJNL"
+static const uint32 InventoryJournalMagic = 0x4C4E4A54;
+
+// bump when the layout of the journal changes
+static const uint8 InventoryJournalVersion = 1;
+
+// what each entry in the file is
+enum class EJournalEntry : uint8
+{
+	// id and string of a name used by the entries after it
+	Name,
+	// inventory id, class id, packed quantity and equipped
+	State,
+	// inventory id, its earlier entries no longer count
+	Reset
+};
+
+FInventoryJournal::FInventoryJournal(const FString& InFilePath, const float InFlushInterval)
+	: FilePath(InFilePath)
+	, FlushInterval(InFlushInterval)
+{
+	WakeEvent = FPlatformProcess::GetSynchEventFromPool();
+
+	// without threads the records are written as they are appended
+	if (FPlatformProcess::SupportsMultithreading())
+	{
+		Thread = FRunnableThread::Create(this, TEXT("InventoryJournal"), 0, TPri_BelowNormal);
+	}
+}
+
+FInventoryJournal::~FInventoryJournal()
+{
+	if (Thread)
+	{
+		// Run writes what is left before it returns
+		Thread->Kill(true);
+		delete Thread;
+		Thread = nullptr;
+	}
+	else
+	{
+		WritePending();
+	}
+
+	FPlatformProcess::ReturnSynchEventToPool(WakeEvent);
+	WakeEvent = nullptr;
+
+	delete File;
+	File = nullptr;
+}
+
+void FInventoryJournal::Append(const FName InventoryKey, const UClass* ItemClass, const int32 Quantity, const bool bEquipped)
+{
+	if (!ItemClass)
+	{
+		return;
+	}
+
+	FName* ItemClassPath = ClassPathNames.Find(ItemClass);
+	if (!ItemClassPath)
+	{
+		ItemClassPath = &ClassPathNames.Add(ItemClass, FName(*ItemClass->GetPathName()));
+	}
+
+	Append(InventoryKey, *ItemClassPath, Quantity, bEquipped);
+}
+
+void FInventoryJournal::Append(const FName InventoryKey, const FName ItemClassPath, const int32 Quantity, const bool bEquipped)
+{
+	Records.Enqueue({ ERecordType::State, InventoryKey, ItemClassPath, Quantity, bEquipped });
+
+	if (!Thread)
+	{
+		WritePending();
+	}
+}
+
+void FInventoryJournal::AppendReset(const FName InventoryKey)
+{
+	Records.Enqueue({ ERecordType::Reset, InventoryKey, NAME_None, 0, false });
+
+	if (!Thread)
+	{
+		WritePending();
+	}
+}
+
+void FInventoryJournal::Truncate()
+{
+	Records.Enqueue({ ERecordType::Truncate, NAME_None, NAME_None, 0, false });
+
+	// get the old records out of the way straight away
+	if (Thread)
+	{
+		WakeEvent->Trigger();
+	}
+	else
+	{
+		WritePending();
+	}
+}
+
+uint32 FInventoryJournal::Run()
+{
+	const uint32 WaitMs = FMath::Max(FMath::RoundToInt(FlushInterval * 1000.f), 1);
+
+	// records are written in batches, one flush to disk per batch
+	while (!bStopping)
+	{
+		WakeEvent->Wait(WaitMs);
+		WritePending();
+	}
+
+	WritePending();
+	return 0;
+}
+
+void FInventoryJournal::Stop()
+{
+	bStopping = true;
+	WakeEvent->Trigger();
+}
+
+void FInventoryJournal::WritePending()
+{
+	if (Records.IsEmpty())
+	{
+		return;
+	}
+
+	if (!File)
+	{
+		OpenFile(false);
+	}
+
+	WriteBuffer.Reset();
+	FMemoryWriter Writer(WriteBuffer);
+
+	// ids are only assigned once per name, so most entries are a handful of bytes
+	auto WriteName = [this, &Writer](const FName Name) -> uint32
+	{
+		if (const uint32* Id = WrittenNames.Find(Name))
+		{
+			return *Id;
+		}
+
+		uint32 Id = WrittenNames.Num();
+		WrittenNames.Add(Name, Id);
+
+		EJournalEntry Entry = EJournalEntry::Name;
+		FString NameString = Name.ToString();
+		Writer << Entry;
+		Writer.SerializeIntPacked(Id);
+		Writer << NameString;
+		return Id;
+	};
+
+	FRecord Record;
+	while (Records.Dequeue(Record))
+	{
+		if (Record.Type == ERecordType::Truncate)
+		{
+			// everything before the truncate is dropped, including what was buffered
+			WriteBuffer.Reset();
+			Writer.Seek(0);
+			OpenFile(true);
+			continue;
+		}
+
+		uint32 InventoryId = WriteName(Record.InventoryKey);
+
+		if (Record.Type == ERecordType::Reset)
+		{
+			EJournalEntry Entry = EJournalEntry::Reset;
+			Writer << Entry;
+			Writer.SerializeIntPacked(InventoryId);
+			continue;
+		}
+
+		uint32 ClassId = WriteName(Record.ItemClassPath);
+		uint32 Quantity = FMath::Max(Record.Quantity, 0);
+		uint8 bEquipped = Record.bEquipped;
+
+		EJournalEntry Entry = EJournalEntry::State;
+		Writer << Entry;
+		Writer.SerializeIntPacked(InventoryId);
+		Writer.SerializeIntPacked(ClassId);
+		Writer.SerializeIntPacked(Quantity);
+		Writer << bEquipped;
+	}
+
+	if (File && WriteBuffer.Num() > 0)
+	{
+		File->Write(WriteBuffer.GetData(), WriteBuffer.Num());
+		File->Flush(true);
+	}
+}
+
+void FInventoryJournal::OpenFile(const bool bTruncate)
+{
+	delete File;
+	File = FPlatformFileManager::Get().GetPlatformFile().OpenWrite(*FilePath, !bTruncate, false);
+
+	// a new file doesn't know any names yet
+	WrittenNames.Reset();
+
+	if (!File)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Couldn't open inventory journal %s"), *FilePath);
+		return;
+	}
+
+	// ids from an earlier run can't be reused, so an appended run starts a new header and redefines its names
+	uint32 Magic = InventoryJournalMagic;
+	uint8 Version = InventoryJournalVersion;
+
+	TArray<uint8> Header;
+	FMemoryWriter Writer(Header);
+	Writer << Magic;
+	Writer << Version;
+	File->Write(Header.GetData(), Header.Num());
+}
+
+bool FInventoryJournal::Read(const FString& InFilePath, TMap<FName, FInventoryJournalState>& OutStates)
+{
+	TArray<uint8> FileData;
+	if (!FFileHelper::LoadFileToArray(FileData, *InFilePath, FILEREAD_Silent))
+	{
+		return false;
+	}
+
+	FMemoryReader Reader(FileData);
+	TMap<uint32, FName> Names;
+
+	while (!Reader.AtEnd())
+	{
+		// each open of the file starts with a header
+		const int64 EntryStart = Reader.Tell();
+		uint32 Magic = 0;
+		Reader << Magic;
+		if (!Reader.IsError() && Magic == InventoryJournalMagic)
+		{
+			uint8 Version = 0;
+			Reader << Version;
+			if (Reader.IsError() || Version != InventoryJournalVersion)
+			{
+				break;
+			}
+
+			Names.Reset();
+			continue;
+		}
+
+		Reader.ClearError();
+		Reader.Seek(EntryStart);
+
+		EJournalEntry Entry;
+		Reader << Entry;
+
+		if (Entry == EJournalEntry::Name)
+		{
+			uint32 Id = 0;
+			FString NameString;
+			Reader.SerializeIntPacked(Id);
+
+			// a torn or corrupt record can claim any length, stop there instead of allocating it
+			if (Reader.IsError() || !IsStringLengthInBounds(Reader))
+			{
+				break;
+			}
+
+			Reader << NameString;
+			if (Reader.IsError())
+			{
+				break;
+			}
+
+			Names.Add(Id, FName(*NameString));
+		}
+		else if (Entry == EJournalEntry::Reset)
+		{
+			uint32 InventoryId = 0;
+			Reader.SerializeIntPacked(InventoryId);
+			const FName* InventoryKey = Names.Find(InventoryId);
+			if (Reader.IsError() || !InventoryKey)
+			{
+				break;
+			}
+
+			FInventoryJournalState& State = OutStates.FindOrAdd(*InventoryKey);
+			State.bComplete = true;
+			State.Classes.Reset();
+		}
+		else if (Entry == EJournalEntry::State)
+		{
+			uint32 InventoryId = 0;
+			uint32 ClassId = 0;
+			uint32 Quantity = 0;
+			uint8 bEquipped = 0;
+			Reader.SerializeIntPacked(InventoryId);
+			Reader.SerializeIntPacked(ClassId);
+			Reader.SerializeIntPacked(Quantity);
+			Reader << bEquipped;
+
+			const FName* InventoryKey = Names.Find(InventoryId);
+			const FName* ItemClassPath = Names.Find(ClassId);
+			if (Reader.IsError() || !InventoryKey || !ItemClassPath)
+			{
+				break;
+			}
+
+			FInventoryJournalClassState& ClassState = OutStates.FindOrAdd(*InventoryKey).Classes.FindOrAdd(*ItemClassPath);
+			ClassState.Quantity = (int32)FMath::Min<uint32>(Quantity, MAX_int32);
+			ClassState.bEquipped = bEquipped != 0;
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	// a crash can leave the last batch half written, everything before it still counts
+	if (!Reader.AtEnd())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Inventory journal %s ends with an incomplete record, replaying what was read"), *InFilePath);
+	}
+
+	return true;
+}
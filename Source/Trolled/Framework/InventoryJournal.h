@@ -0,0 +1,103 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+#include "HAL/ThreadSafeBool.h"
+#include "Containers/Queue.h"
+
+// the last journaled state of one item class in an inventory
+struct FInventoryJournalClassState
+{
+	int32 Quantity = 0;
+	bool bEquipped = false;
+};
+
+// everything journaled for one inventory
+struct FInventoryJournalState
+{
+	// the journal has the full contents, the inventory starts empty instead of from its snapshot
+	bool bComplete = false;
+
+	// by item class path
+	TMap<FName, FInventoryJournalClassState> Classes;
+};
+
+/**
+ * Append only journal of inventory changes, so a crash between snapshots doesn't lose anything
+ * Each record is the absolute state of one item class in one inventory, so replaying the last record of each class on top of
+ * the inventories snapshot gives the state at the crash. The game thread only pushes fixed size records into a lock free queue,
+ * a background thread writes them out in batches with one flush per batch
+ */
+class TROLLED_API FInventoryJournal : public FRunnable
+{
+public:
+
+	FInventoryJournal(const FString& InFilePath, const float InFlushInterval);
+
+	// writes anything still queued and stops the writer thread
+	virtual ~FInventoryJournal();
+
+	// [game thread] journal the state of an item class in an inventory
+	void Append(const FName InventoryKey, const UClass* ItemClass, const int32 Quantity, const bool bEquipped);
+	void Append(const FName InventoryKey, const FName ItemClassPath, const int32 Quantity, const bool bEquipped);
+
+	// [game thread] the records that follow for this inventory are its full contents
+	void AppendReset(const FName InventoryKey);
+
+	// [game thread] empties the journal file, records appended after this are kept
+	void Truncate();
+
+	// reads a journal file, stopping at the first incomplete record. Returns false if there is no readable journal
+	static bool Read(const FString& FilePath, TMap<FName, FInventoryJournalState>& OutStates);
+
+	// FRunnable
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+
+private:
+
+	enum class ERecordType : uint8
+	{
+		// the inventory class state
+		State,
+		// the inventory only has what follows
+		Reset,
+		// empty the file
+		Truncate
+	};
+
+	// fixed size so pushing one never allocates anything but the queue node
+	struct FRecord
+	{
+		ERecordType Type;
+		FName InventoryKey;
+		FName ItemClassPath;
+		int32 Quantity;
+		bool bEquipped;
+	};
+
+	// [writer thread] writes every queued record and flushes the file once
+	void WritePending();
+
+	// [writer thread] opens the file, emptying it if bTruncate
+	void OpenFile(const bool bTruncate);
+
+	FString FilePath;
+	float FlushInterval;
+
+	TQueue<FRecord, EQueueMode::Mpsc> Records;
+
+	FRunnableThread* Thread = nullptr;
+	FEvent* WakeEvent = nullptr;
+	FThreadSafeBool bStopping;
+
+	// [writer thread] open journal and the ids of the names already written to it
+	class IFileHandle* File = nullptr;
+	TMap<FName, uint32> WrittenNames;
+	TArray<uint8> WriteBuffer;
+
+	// [game thread] class path names, so a record doesn't build a path string
+	TMap<const UClass*, FName> ClassPathNames;
+};
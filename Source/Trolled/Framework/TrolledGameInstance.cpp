@@ -2,4 +2,243 @@
 
 
 #include "TrolledGameInstance.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "Trolled/Components/InventoryComponent.h"
+#include "Trolled/Trolled.h"
 
+// bump when the layout of the snapshot file changes, the snapshots themselves carry their own version
+static const uint8 InventorySnapshotFileVersion = 1;
+
+void UTrolledGameInstance::Init()
+{
+	Super::Init();
+
+	LoadInventorySnapshots();
+
+	// changes made since the snapshots, applied as each inventory is restored
+	FInventoryJournal::Read(FPaths::ProjectSavedDir() / InventoryJournalFile, PendingJournalStates);
+}
+
+void UTrolledGameInstance::Shutdown()
+{
+	if (InventorySnapshots.Num() > 0 || JournaledInventories.Num() > 0)
+	{
+		SaveInventorySnapshots();
+	}
+
+	// writes what is left in the queue and stops the writer thread
+	InventoryJournal.Reset();
+
+	Super::Shutdown();
+}
+
+void UTrolledGameInstance::StoreInventory(const FString& Key, class UInventoryComponent* Inventory)
+{
+	if (Inventory && !Key.IsEmpty())
+	{
+		Inventory->SaveSnapshot(InventorySnapshots.FindOrAdd(Key));
+
+		// anything journaled for the key before now is replaced by the snapshot
+		PendingJournalStates.Remove(FName(*Key));
+		TrackInventory(FName(*Key), Inventory);
+	}
+}
+
+bool UTrolledGameInstance::RestoreInventory(const FString& Key, class UInventoryComponent* Inventory)
+{
+	if (!Inventory || Key.IsEmpty())
+	{
+		return false;
+	}
+
+	const FName KeyName(*Key);
+	const FInventoryJournalState* JournalState = PendingJournalStates.Find(KeyName);
+
+	// a complete journal replaces the snapshot, otherwise it is applied on top of it
+	bool bRestored = false;
+	const TArray<uint8>* Snapshot = InventorySnapshots.Find(Key);
+	if (Snapshot && !(JournalState && JournalState->bComplete))
+	{
+		bRestored = Inventory->LoadSnapshot(*Snapshot);
+	}
+
+	if (JournalState)
+	{
+		Inventory->ApplyJournalState(*JournalState);
+		PendingJournalStates.Remove(KeyName);
+		bRestored = true;
+	}
+
+	TrackInventory(KeyName, Inventory);
+	return bRestored;
+}
+
+void UTrolledGameInstance::JournalInventoryClass(const FName Key, const UClass* ItemClass, const int32 Quantity, const bool bEquipped)
+{
+	GetInventoryJournal().Append(Key, ItemClass, Quantity, bEquipped);
+}
+
+FInventoryJournal& UTrolledGameInstance::GetInventoryJournal()
+{
+	if (!InventoryJournal)
+	{
+		InventoryJournal = MakeUnique<FInventoryJournal>(FPaths::ProjectSavedDir() / InventoryJournalFile, InventoryJournalFlushInterval);
+
+		// start a clean file with whatever the last run journaled and hasn't been restored yet
+		InventoryJournal->Truncate();
+		AppendPendingJournalStates();
+	}
+
+	return *InventoryJournal;
+}
+
+void UTrolledGameInstance::AppendPendingJournalStates()
+{
+	for (const TPair<FName, FInventoryJournalState>& Pair : PendingJournalStates)
+	{
+		if (Pair.Value.bComplete)
+		{
+			InventoryJournal->AppendReset(Pair.Key);
+		}
+
+		for (const TPair<FName, FInventoryJournalClassState>& ClassPair : Pair.Value.Classes)
+		{
+			InventoryJournal->Append(Pair.Key, ClassPair.Key, ClassPair.Value.Quantity, ClassPair.Value.bEquipped);
+		}
+	}
+}
+
+void UTrolledGameInstance::UntrackInventory(const FName Key, class UInventoryComponent* Inventory)
+{
+	// the inventory is going away, keep its last state as the snapshot so emptying the journal doesn't lose it
+	if (Inventory && JournaledInventories.FindRef(Key) == Inventory)
+	{
+		Inventory->SaveSnapshot(InventorySnapshots.FindOrAdd(Key.ToString()));
+		JournaledInventories.Remove(Key);
+	}
+}
+
+void UTrolledGameInstance::TrackInventory(const FName Key, class UInventoryComponent* Inventory)
+{
+	JournaledInventories.Add(Key, Inventory);
+
+	// the journal gets the full contents now, so it doesn't depend on which snapshot ends up on disk
+	GetInventoryJournal().AppendReset(Key);
+	Inventory->SetJournalKey(Key);
+}
+
+bool UTrolledGameInstance::SaveInventorySnapshots()
+{
+	// the snapshots are about to cover every change, so take them from the live inventories
+	for (auto It = JournaledInventories.CreateIterator(); It; ++It)
+	{
+		if (UInventoryComponent* Inventory = It.Value().Get())
+		{
+			Inventory->SaveSnapshot(InventorySnapshots.FindOrAdd(It.Key().ToString()));
+		}
+		else
+		{
+			It.RemoveCurrent();
+		}
+	}
+
+	TArray<uint8> FileData;
+	FMemoryWriter Writer(FileData);
+
+	uint8 Version = InventorySnapshotFileVersion;
+	Writer << Version;
+
+	// the snapshots are written as they are, each one is a length and a block copy
+	uint32 NumSnapshots = InventorySnapshots.Num();
+	Writer.SerializeIntPacked(NumSnapshots);
+	for (const TPair<FString, TArray<uint8>>& Pair : InventorySnapshots)
+	{
+		// same layout as serializing the array, without copying it to get a non const reference
+		FString Key = Pair.Key;
+		int32 SnapshotSize = Pair.Value.Num();
+		Writer << Key;
+		Writer << SnapshotSize;
+		Writer.Serialize(const_cast<uint8*>(Pair.Value.GetData()), SnapshotSize);
+	}
+
+	if (!FFileHelper::SaveArrayToFile(FileData, *GetInventorySnapshotPath()))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Couldn't write inventory snapshots to %s"), *GetInventorySnapshotPath());
+		return false;
+	}
+
+	// everything journaled so far is in the file now, apart from inventories that haven't been restored since the last run
+	if (InventoryJournal)
+	{
+		InventoryJournal->Truncate();
+		AppendPendingJournalStates();
+	}
+
+	return true;
+}
+
+bool UTrolledGameInstance::LoadInventorySnapshots()
+{
+	TArray<uint8> FileData;
+	if (!FFileHelper::LoadFileToArray(FileData, *GetInventorySnapshotPath(), FILEREAD_Silent))
+	{
+		return false;
+	}
+
+	FMemoryReader Reader(FileData);
+
+	uint8 Version = 0;
+	Reader << Version;
+
+	uint32 NumSnapshots = 0;
+	Reader.SerializeIntPacked(NumSnapshots);
+	if (Reader.IsError() || Version != InventorySnapshotFileVersion || NumSnapshots > (uint32)FileData.Num())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Inventory snapshot file %s is from another version or corrupt, ignoring it"), *GetInventorySnapshotPath());
+		return false;
+	}
+
+	TMap<FString, TArray<uint8>> LoadedSnapshots;
+	LoadedSnapshots.Reserve(NumSnapshots);
+	for (uint32 i = 0; i < NumSnapshots; ++i)
+	{
+		// lengths are checked against what's left of the file before anything is allocated for them
+		if (!IsStringLengthInBounds(Reader))
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Inventory snapshot file %s is corrupt, ignoring it"), *GetInventorySnapshotPath());
+			return false;
+		}
+
+		FString Key;
+		int32 SnapshotSize = 0;
+		Reader << Key;
+		Reader << SnapshotSize;
+
+		if (Reader.IsError() || SnapshotSize < 0 || SnapshotSize > Reader.TotalSize() - Reader.Tell())
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Inventory snapshot file %s is corrupt, ignoring it"), *GetInventorySnapshotPath());
+			return false;
+		}
+
+		TArray<uint8>& Snapshot = LoadedSnapshots.FindOrAdd(Key);
+		Snapshot.SetNumUninitialized(SnapshotSize);
+		Reader.Serialize(Snapshot.GetData(), SnapshotSize);
+
+		if (Reader.IsError())
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Inventory snapshot file %s is corrupt, ignoring it"), *GetInventorySnapshotPath());
+			return false;
+		}
+	}
+
+	InventorySnapshots = MoveTemp(LoadedSnapshots);
+	return true;
+}
+
+FString UTrolledGameInstance::GetInventorySnapshotPath() const
+{
+	return FPaths::ProjectSavedDir() / InventorySnapshotFile;
+}
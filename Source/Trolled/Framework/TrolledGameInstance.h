@@ -4,14 +4,82 @@
 
 #include "CoreMinimal.h"
 #include "Engine/GameInstance.h"
+#include "Trolled/Framework/InventoryJournal.h"
 #include "TrolledGameInstance.generated.h"
 
 /**
- * 
+ * Keeps inventory snapshots for the server, so inventories outlive the actors that own them and survive a restart
+ * Inventories that have been stored or restored journal every change, the journal is replayed on top of the snapshots after a crash
  */
-UCLASS()
+UCLASS(Config = Game)
 class TROLLED_API UTrolledGameInstance : public UGameInstance
 {
 	GENERATED_BODY()
-	
+
+public:
+
+	// reads the snapshots saved by the last run
+	virtual void Init() override;
+
+	// writes the snapshots to disk
+	virtual void Shutdown() override;
+
+	// [server] snapshots the inventory under Key, replacing any older snapshot. Its changes are journaled from then on
+	UFUNCTION(BlueprintCallable, Category = "Persistence")
+	void StoreInventory(const FString& Key, class UInventoryComponent* Inventory);
+
+	// [server] fills the inventory from the snapshot stored under Key and any journaled changes since, false if there is neither
+	// its changes are journaled from then on
+	UFUNCTION(BlueprintCallable, Category = "Persistence")
+	bool RestoreInventory(const FString& Key, class UInventoryComponent* Inventory);
+
+	// re-snapshots the journaled inventories and writes every stored snapshot to the snapshot file, then empties the journal
+	// false if the file couldn't be written
+	UFUNCTION(BlueprintCallable, Category = "Persistence")
+	bool SaveInventorySnapshots();
+
+	// [server] called by journaled inventories when an item class changes
+	void JournalInventoryClass(const FName Key, const UClass* ItemClass, const int32 Quantity, const bool bEquipped);
+
+	// [server] called by journaled inventories when they end play, keeps their last state as their snapshot
+	void UntrackInventory(const FName Key, class UInventoryComponent* Inventory);
+
+	// replaces the stored snapshots with the ones in the snapshot file, false if there is no readable file
+	bool LoadInventorySnapshots();
+
+protected:
+
+	// file in the saved directory the snapshots are written to
+	UPROPERTY(Config)
+	FString InventorySnapshotFile = TEXT("InventorySnapshots.bin");
+
+	// snapshots by key, kept as the bytes from UInventoryComponent::SaveSnapshot so writing them out is just a copy
+	TMap<FString, TArray<uint8>> InventorySnapshots;
+
+	// full path of InventorySnapshotFile
+	FString GetInventorySnapshotPath() const;
+
+	// file in the saved directory inventory changes are journaled to
+	UPROPERTY(Config)
+	FString InventoryJournalFile = TEXT("InventoryJournal.bin");
+
+	// how often in seconds the journal writer flushes to disk, the most that can be lost in a crash
+	UPROPERTY(Config)
+	float InventoryJournalFlushInterval = 0.2f;
+
+	// created the first time an inventory is stored or restored, so only servers write a journal
+	TUniquePtr<FInventoryJournal> InventoryJournal;
+	FInventoryJournal& GetInventoryJournal();
+
+	// journaled changes read at startup for inventories that haven't been restored yet
+	TMap<FName, FInventoryJournalState> PendingJournalStates;
+
+	// writes PendingJournalStates back into an emptied journal so they survive another crash
+	void AppendPendingJournalStates();
+
+	// inventories being journaled, by key
+	TMap<FName, TWeakObjectPtr<class UInventoryComponent>> JournaledInventories;
+
+	// starts journaling an inventory under Key
+	void TrackInventory(const FName Key, class UInventoryComponent* Inventory);
 };
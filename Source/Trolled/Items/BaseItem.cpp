@@ -59,6 +59,12 @@ UBaseItem::UBaseItem()
 
 void UBaseItem::OnRep_Quantity() 
 {
+    // items in an inventory get their quantity from the inventory's entry, this only catches the initial value
+    if (OwningInventory)
+    {
+        OwningInventory->RefreshClassTotals(this);
+    }
+
     OnItemModified.Broadcast();
 }
 
@@ -67,8 +73,18 @@ void UBaseItem::SetQuantity(const int32 NewQuantity)
     if(NewQuantity != Quantity)
     {   
         // clamp NewQuantity quant min at 0 to prevent negative, up to max stack size if its stackable, otherwise max is 1
+        const int32 OldQuantity = Quantity;
         Quantity = FMath::Clamp(NewQuantity, 0, bStackable ? MaxStackSize : 1);
-        MarkDirtyForReplication();
+
+        // items in an inventory send their quantity through the inventory's entry instead of replicating the whole item again
+        if (OwningInventory)
+        {
+            OwningInventory->OnItemQuantityChanged(this, Quantity - OldQuantity);
+        }
+        else
+        {
+            MarkDirtyForReplication();
+        }
     }
 }
 
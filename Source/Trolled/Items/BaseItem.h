@@ -135,3 +135,32 @@ public:
 	void MarkDirtyForReplication();
 };
 
+
+// an amount of an item without a UObject behind it, used for pickups and for adding to inventories
+// everything that doesn't change per stack (name, mesh, weight, stack size) is read from the item class default object
+USTRUCT(BlueprintType)
+struct FItemInstance
+{
+	GENERATED_BODY()
+
+	FItemInstance()
+	{
+		ItemClass = nullptr;
+		Quantity = 0;
+	}
+
+	FItemInstance(const TSubclassOf<UBaseItem> InItemClass, const int32 InQuantity) : ItemClass(InItemClass), Quantity(InQuantity) {};
+
+	// the item this is an amount of
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Item")
+	TSubclassOf<UBaseItem> ItemClass;
+
+	// how many of the item
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Item", meta = (UIMin = 1))
+	int32 Quantity;
+
+	// shared static data of the item, never modify it
+	FORCEINLINE const UBaseItem* GetDefinition() const { return ItemClass ? GetDefault<UBaseItem>(ItemClass) : nullptr; }
+
+	FORCEINLINE bool IsValid() const { return ItemClass && Quantity > 0; }
+};
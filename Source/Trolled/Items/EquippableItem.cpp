@@ -1,7 +1,6 @@
 // Fill out your copyright notice in the Description page of Project Settings.
 
 #include "EquippableItem.h"
-#include "Net/UnrealNetwork.h"
 #include "Trolled/MainCharacter.h"
 #include "Trolled/Components/InventoryComponent.h"
 
@@ -14,13 +13,6 @@ UEquippableItem::UEquippableItem()
 	UseActionText = LOCTEXT("EquipText", "Equip");
 }
 
-void UEquippableItem::GetLifetimeReplicatedProps(TArray<class FLifetimeProperty> & OutLifetimeProps) const
-{
-	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
-
-	DOREPLIFETIME(UEquippableItem, bEquipped);
-}
-
 // setup use
 void UEquippableItem::Use(class AMainCharacter* Character)
 {
@@ -90,10 +82,15 @@ void UEquippableItem::AddedToInventory(class UInventoryComponent* Inventory)
 
 void UEquippableItem::SetEquipped(bool bNewEquipped)
 {
-    // set bEquipped when equipped, update stats then mark for replication
+    // set bEquipped when equipped, update stats then send it to clients
 	bEquipped = bNewEquipped;
 	EquipStatusChanged();
-	MarkDirtyForReplication();
+
+	// items in an inventory send their equip state through the inventory's entry, like quantity
+	if (OwningInventory)
+	{
+		OwningInventory->OnItemEquippedChanged(this);
+	}
 }
 
 void UEquippableItem::EquipStatusChanged()
@@ -117,6 +114,11 @@ void UEquippableItem::EquipStatusChanged()
 
 	// Tell delegate to update UI
 	OnItemModified.Broadcast();
+
+	if (OwningInventory)
+	{
+		OwningInventory->QueueChange(this, EInventoryChangeType::ICT_EquippedChanged);
+	}
 }
 
 #undef LOCTEXT_NAMESPACE
\ No newline at end of file
@@ -28,6 +28,9 @@ class TROLLED_API UEquippableItem : public UBaseItem
 {
 	GENERATED_BODY()
 
+	// the inventory applies the equip state it receives in its entries
+	friend class UInventoryComponent;
+
 public:
 
 	UEquippableItem();
@@ -35,8 +38,6 @@ public:
 	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Equippables")
 	EEquippableSlot Slot;
 
-	virtual void GetLifetimeReplicatedProps(TArray<class FLifetimeProperty> & OutLifetimeProps) const override;
-
 	// override for how equipment is used
 	virtual void Use(class AMainCharacter* Character) override;
 
@@ -55,14 +56,15 @@ public:
 
 	// track if something is equipped
 	UFUNCTION(BlueprintPure, Category = "Equippables")
-	bool IsEquipped() { return bEquipped; };
+	bool IsEquipped() const { return bEquipped; };
 
 	// Call this on the server to equip the item
 	void SetEquipped(bool bNewEquipped);
 
 protected:
 
-	UPROPERTY(ReplicatedUsing = EquipStatusChanged)
+	// sent to clients through the owning inventory's entry, not replicated on the item
+	UPROPERTY()
 	bool bEquipped;
 
 	UFUNCTION()
@@ -12,6 +12,8 @@
 #include "Components/CapsuleComponent.h"
 #include "Kismet/GameplayStatics.h"
 #include "Components/InteractionComponent.h"
+#include "Trolled/Components/HitboxHistoryComponent.h"
+#include "Trolled/Components/InteractionSubsystem.h"
 #include "Trolled/Player/TrolledPlayerController.h"
 #include "Trolled/Components/InventoryComponent.h"
 #include "Trolled/Weapons/TrolledDamageTypes.h"
@@ -126,9 +128,22 @@ AMainCharacter::AMainCharacter()
 	LootPlayerInteraction->SetActive(false, true);
 	LootPlayerInteraction->bAutoActivate = false;
 
+	// create the hitbox history used by the server to rewind this character when validating hits
+	HitboxHistory = CreateDefaultSubobject<UHitboxHistoryComponent>("HitboxHistory");
+
 	// check every 0.2, max interaction distance 10m
 	InteractionCheckFrequency = 0.2f;
 	InteractionCheckDistance = 1000.f;
+	InteractionConeAngle = 15.f;
+	InteractionCheckMoveThreshold = 10.f;
+	InteractionCheckRotationThreshold = 2.f;
+	InteractionCheckFallbackInterval = 1.f;
+	InteractionValidationLeeway = 50.f;
+	InteractionValidationAngle = 45.f;
+	InteractionValidationCacheTime = 1.f;
+	ValidatedViewLocation = FVector::ZeroVector;
+	ValidatedTime = -1.f;
+	bValidatedVisible = false;
 
 	// set player stats
 	MaxHealth = 100.f;
@@ -154,6 +169,9 @@ AMainCharacter::AMainCharacter()
 	// default to not ADS
 	bIsAiming = false;
 
+	// enough for a primary, secondary and a spare
+	MaxCachedWeapons = 3;
+
 	// Allows the character to crouch
 	GetCharacterMovement()->NavAgentProps.bCanCrouch = true;
 }
@@ -180,6 +198,25 @@ void AMainCharacter::BeginPlay()
 	
 }
 
+void AMainCharacter::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	// put away weapons are hidden, so nothing else would clean them up
+	if (HasAuthority())
+	{
+		for (auto& CachedWeapon : CachedWeapons)
+		{
+			if (IsValid(CachedWeapon.Value))
+			{
+				CachedWeapon.Value->Destroy();
+			}
+		}
+
+		CachedWeapons.Empty();
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
 void AMainCharacter::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const 
 {
 	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
@@ -222,8 +259,9 @@ void AMainCharacter::Tick(float DeltaTime)
 	const bool bIsInteractingOnServer = (!HasAuthority() && IsInteracting());
 
 	// if not the server or a player that is interacting and if the time 
-	// since last check is greater than check frequency, check again
-	if ((!HasAuthority() || bIsInteractingOnServer) && GetWorld()->TimeSince(InteractionData.LastInteractionCheckTime) > InteractionCheckFrequency)
+	// since last check is greater than check frequency, check again if anything changed
+	if ((!HasAuthority() || bIsInteractingOnServer) && GetWorld()->TimeSince(InteractionData.LastInteractionCheckTime) > InteractionCheckFrequency
+		&& ShouldPerformInteractionCheck())
 	{
 		// checks if the player is looking at an interactable
 		PerformInteractionCheck();
@@ -341,6 +379,16 @@ void AMainCharacter::SetLootSource(class UInventoryComponent* NewLootSource)
 			}
 		}
 
+		// contents are only sent to the player while they have the inventory open
+		if (LootSource)
+		{
+			LootSource->RemoveLooter(PlayerInventory);
+		}
+		if (NewLootSource)
+		{
+			NewLootSource->AddLooter(PlayerInventory);
+		}
+
 		// set loot source to the new player who is looting
 		LootSource = NewLootSource;
 
@@ -390,6 +438,12 @@ void AMainCharacter::OnRep_LootSource()
 	{
 		if (PC->IsLocalController())
 		{
+			// the loot sources contents arrive in our own inventories LootList
+			if (PlayerInventory)
+			{
+				PlayerInventory->SetLootedInventory(LootSource);
+			}
+
 			// from final, not in video
 			// if (ASurvivalHUD* HUD = Cast<ASurvivalHUD>(PC->GetHUD()))
 			// {
@@ -419,48 +473,109 @@ void AMainCharacter::OnRep_LootSource()
 }
 
 void AMainCharacter::LootItem(class UBaseItem* ItemToGive) 
+{
+	// a single item goes through the same transfer as a selection, so it doesn't need its own refresh RPC
+	if (HasAuthority())
+	{
+		if (ItemToGive)
+		{
+			LootItems({ ItemToGive });
+		}
+	}
+	// if player, request server to give loot
+	else
+	{
+		ServerLootItem(ItemToGive);
+	}
+}
+
+void AMainCharacter::ServerLootItem_Implementation(class UBaseItem* ItemToLoot) 
+{
+	// call loot item function
+	LootItem(ItemToLoot);
+}
+
+bool AMainCharacter::ServerLootItem_Validate(class UBaseItem* ItemToLoot) 
+{
+	return true;
+}
+
+void AMainCharacter::LootItems(const TArray<class UBaseItem*>& ItemsToGive)
 {
 	// if server
 	if (HasAuthority())
 	{
-		// valid inventory, loot source, item, item class and quantity being asked for
-		if (PlayerInventory && LootSource && ItemToGive && LootSource->HasItemQuantity(ItemToGive->GetClass(), ItemToGive->GetQuantity()))
+		if (PlayerInventory && LootSource)
 		{
-			// move the item to the requesting player
-			const FItemAddResult AddResult = PlayerInventory->TryAddItem(ItemToGive);
+			// moves everything that fits in one pass, the loot source skips items it doesn't own
+			FText ErrorText;
+			LootSource->TransferItems(PlayerInventory, ItemsToGive, ErrorText);
 
-			// if that amount is more than 0
-			if (AddResult.AmountToGive > 0)
+			// one notification for the whole selection
+			if (!ErrorText.IsEmpty())
 			{
-				// remove the item from the loot source
-				LootSource->ConsumeQuantity(ItemToGive, AddResult.AmountToGive);
+				if (ATrolledPlayerController* PC = Cast<ATrolledPlayerController>(GetController()))
+				{
+					PC->ClientShowNotification(ErrorText);
+				}
 			}
-			else
+		}
+	}
+	// if player, request server to give loot
+	else
+	{
+		ServerLootItems(ItemsToGive);
+	}
+}
+
+void AMainCharacter::LootAllItems()
+{
+	// if server
+	if (HasAuthority())
+	{
+		if (PlayerInventory && LootSource)
+		{
+			FText ErrorText;
+			LootSource->TransferAllItems(PlayerInventory, ErrorText);
+
+			if (!ErrorText.IsEmpty())
 			{
-				// check that looting controller is valid
-				
 				if (ATrolledPlayerController* PC = Cast<ATrolledPlayerController>(GetController()))
 				{
-					// tell player why they couldn't loot the item
-					PC->ClientShowNotification(AddResult.ErrorText);
+					PC->ClientShowNotification(ErrorText);
 				}
 			}
 		}
 	}
-	// if player, request server to give loot
+	// if player, request server to give loot, no item list needs to be sent
 	else
 	{
-		ServerLootItem(ItemToGive);
+		ServerLootAllItems();
 	}
 }
 
-void AMainCharacter::ServerLootItem_Implementation(class UBaseItem* ItemToLoot) 
+void AMainCharacter::ServerLootItems_Implementation(const TArray<class UBaseItem*>& ItemsToLoot)
 {
-	// call loot item function
-	LootItem(ItemToLoot);
+	// the loot source can't hold more stacks than its capacity, so a longer list isn't a real selection
+	if (!LootSource || ItemsToLoot.Num() > LootSource->GetInventoryCapacity())
+	{
+		return;
+	}
+
+	LootItems(ItemsToLoot);
 }
 
-bool AMainCharacter::ServerLootItem_Validate(class UBaseItem* ItemToLoot) 
+bool AMainCharacter::ServerLootItems_Validate(const TArray<class UBaseItem*>& ItemsToLoot)
+{
+	return true;
+}
+
+void AMainCharacter::ServerLootAllItems_Implementation()
+{
+	LootAllItems();
+}
+
+bool AMainCharacter::ServerLootAllItems_Validate()
 {
 	return true;
 }
@@ -494,45 +609,83 @@ void AMainCharacter::PerformInteractionCheck()
 	// set those variables from the characters point of view
 	GetController()->GetPlayerViewPoint(EyesLoc, EyesRot);
 
-	// Find the max distance the trace can cast from the players current position
-	FVector TraceStart = EyesLoc;
-	FVector TraceEnd = (EyesRot.Vector() * InteractionCheckDistance) + TraceStart;
-	FHitResult TraceHit;
+	UInteractionSubsystem* Interactions = GetWorld()->GetSubsystem<UInteractionSubsystem>();
 
-	// prevents own character from being detected by the line trace
-	FCollisionQueryParams QueryParams;
-	QueryParams.AddIgnoredActor(this);
+	// store what this check saw, the next check only runs once something here changes
+	InteractionData.LastCheckLocation = EyesLoc;
+	InteractionData.LastCheckDirection = EyesRot.Vector();
+	InteractionData.LastCheckChangeStamp = Interactions ? Interactions->GetChangeStamp(EyesLoc, InteractionCheckDistance) : 0;
 
-	// The line trace returns true if the player is looking at anything but itself
-	if (GetWorld()->LineTraceSingleByChannel(TraceHit, TraceStart, TraceEnd, ECC_Visibility, QueryParams))
+	// look up the best interactable in view from the interaction grid instead of tracing the level,
+	// only the best candidates get an occlusion trace
+	UInteractionComponent* InteractionComponent = nullptr;
+	if (Interactions)
 	{
-		// check if the hit was an actor
-		if (TraceHit.GetActor())
-		{
-			// check if it has an interaction component
-			if (UInteractionComponent* InteractionComponent = Cast<UInteractionComponent>(TraceHit.GetActor()->GetComponentByClass(UInteractionComponent::StaticClass())))
-			{
-				// calculates distance to the object
-				float Distance = (TraceStart - TraceHit.ImpactPoint).Size();
+		InteractionComponent = Interactions->FindInteractable(EyesLoc, EyesRot.Vector(), InteractionCheckDistance, InteractionConeAngle, this);
+	}
 
-				// if object is new and distance is less than max interaction distance, found new interactable
-				if (InteractionComponent != GetInteractable() && Distance <= InteractionComponent->InteractionDistance)
-				{
-					FoundNewInteractable(InteractionComponent);
-				}
-				else if (Distance > InteractionComponent->InteractionDistance && GetInteractable())
-				{
-					NoFoundInteractable();
-				}
+	// the grid only returns interactables that are within their interaction distance
+	if (InteractionComponent)
+	{
+		InteractionData.LastCheckTargetLocation = InteractionComponent->GetComponentLocation();
 
-				return;
-			}
+		// if object is new, found new interactable
+		if (InteractionComponent != GetInteractable())
+		{
+			FoundNewInteractable(InteractionComponent);
 		}
+
+		return;
 	}
 
 	NoFoundInteractable();
 }
 
+bool AMainCharacter::ShouldPerformInteractionCheck() const
+{
+	if (!GetController())
+	{
+		return false;
+	}
+
+	// players in the loot screen or any other menu with the cursor up aren't looking around
+	const APlayerController* PC = Cast<APlayerController>(GetController());
+	if (IsLooting() || (PC && PC->bShowMouseCursor))
+	{
+		return false;
+	}
+
+	FVector EyesLoc;
+	FRotator EyesRot;
+	GetController()->GetPlayerViewPoint(EyesLoc, EyesRot);
+
+	// the view moved or turned
+	if (FVector::DistSquared(EyesLoc, InteractionData.LastCheckLocation) > FMath::Square(InteractionCheckMoveThreshold)
+		|| FVector::DotProduct(EyesRot.Vector(), InteractionData.LastCheckDirection) < FMath::Cos(FMath::DegreesToRadians(InteractionCheckRotationThreshold)))
+	{
+		return true;
+	}
+
+	// an interactable was added, removed, turned on or off, or moved between cells near the player
+	const UInteractionSubsystem* Interactions = GetWorld()->GetSubsystem<UInteractionSubsystem>();
+	if (Interactions && Interactions->GetChangeStamp(EyesLoc, InteractionCheckDistance) != InteractionData.LastCheckChangeStamp)
+	{
+		return true;
+	}
+
+	// the focused interactable moved
+	if (const UInteractionComponent* Interactable = GetInteractable())
+	{
+		if (FVector::DistSquared(Interactable->GetComponentLocation(), InteractionData.LastCheckTargetLocation) > FMath::Square(InteractionCheckMoveThreshold))
+		{
+			return true;
+		}
+	}
+
+	// nothing changed, only check again once the fallback interval has passed
+	return InteractionCheckFallbackInterval > 0.f && GetWorld()->TimeSince(InteractionData.LastInteractionCheckTime) > InteractionCheckFallbackInterval;
+}
+
 void AMainCharacter::NoFoundInteractable() 
 {
 	// if theres an active timer, but the object is no longer found, clear the timer
@@ -578,12 +731,12 @@ void AMainCharacter::BeginInteract()
 {
 	if (!HasAuthority())
 	{
-		ServerBeginInteract();
+		ServerBeginInteract(GetInteractable());
 	}
 
-	// If an item is non-instant interact, server checks every tick for the duration of the 
-	// interact so that it continues to focus as the interaction is happening
-	if (HasAuthority())
+	// a listen server host doesn't run interaction checks while idle, so check what it is looking at now.
+	// remote players had their target validated in ServerBeginInteract
+	if (HasAuthority() && IsLocallyControlled())
 	{
 		PerformInteractionCheck();
 	}
@@ -722,24 +875,45 @@ void AMainCharacter::EquipWeapon(class UWeaponItem* WeaponItem)
 			UnEquipWeapon();
 		}
 
-		// setup spawn parameters, disable weapons collision, set owner to local player
-		FActorSpawnParameters SpawnParams;
-		SpawnParams.bNoFail = true;
-		SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButAlwaysSpawn;
-		SpawnParams.Owner = SpawnParams.Instigator = this;
+		// reuse the weapon of this class that was put away earlier, clients already have it so there's no spawn or initial replication
+		AWeapon* Weapon = nullptr;
+		if (CachedWeapons.RemoveAndCopyValue(WeaponItem->WeaponClass, Weapon) && IsValid(Weapon))
+		{
+			Weapon->Unstash();
+		}
+		else
+		{
+			// setup spawn parameters, disable weapons collision, set owner to local player
+			FActorSpawnParameters SpawnParams;
+			SpawnParams.bNoFail = true;
+			SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButAlwaysSpawn;
+			SpawnParams.Owner = SpawnParams.Instigator = this;
+
+			// spawn the weapon in with the class and spawn params
+			Weapon = GetWorld()->SpawnActor<AWeapon>(WeaponItem->WeaponClass, SpawnParams);
+		}
 
-		// spawn the weapon in with the class and spawn params
-		if (AWeapon* Weapon = GetWorld()->SpawnActor<AWeapon>(WeaponItem->WeaponClass, SpawnParams))
+		if (Weapon)
 		{
 			Weapon->BaseItem = WeaponItem;
 
 			EquippedWeapon = Weapon;
+
+#if DO_CHECK
+			// a reused weapon comes back with what was left in its magazine, equipping it can't make or lose any rounds
+			const int32 AmmoBeforeEquip = Weapon->GetCurrentAmmo() + Weapon->GetCurrentAmmoInMag();
+#endif
 			
 			// rep to clients
-			OnRep_EquippedWeapon();
+			OnRep_EquippedWeapon(nullptr);
 
 			// attach mesh to pawn
 			Weapon->OnEquip();
+
+#if DO_CHECK
+			const int32 AmmoAfterEquip = Weapon->GetCurrentAmmo() + Weapon->GetCurrentAmmoInMag();
+			ensureMsgf(AmmoAfterEquip == AmmoBeforeEquip, TEXT("Equipping %s changed the total ammo from %d to %d"), *Weapon->GetName(), AmmoBeforeEquip, AmmoAfterEquip);
+#endif
 		}
 	}
 }
@@ -752,10 +926,33 @@ void AMainCharacter::UnEquipWeapon()
 	// check server and weapon currently equipped
 	if (HasAuthority() && EquippedWeapon)
 	{
-		EquippedWeapon->OnUnEquip();
-		EquippedWeapon->Destroy();
+		AWeapon* OldWeapon = EquippedWeapon;
+
+#if DO_CHECK
+		// unequipping only moves rounds from the magazine to the inventory, it can't make or lose any
+		const int32 AmmoBeforeUnEquip = OldWeapon->GetCurrentAmmo() + OldWeapon->GetCurrentAmmoInMag();
+#endif
+
+		OldWeapon->OnUnEquip();
+
+#if DO_CHECK
+		const int32 AmmoAfterUnEquip = OldWeapon->GetCurrentAmmo() + OldWeapon->GetCurrentAmmoInMag();
+		ensureMsgf(AmmoAfterUnEquip == AmmoBeforeUnEquip, TEXT("Unequipping %s changed the total ammo from %d to %d"), *OldWeapon->GetName(), AmmoBeforeUnEquip, AmmoAfterUnEquip);
+#endif
+
+		// keep the weapon around for the next time its class is equipped, unless the cache is full
+		if (CachedWeapons.Num() < MaxCachedWeapons && !CachedWeapons.Contains(OldWeapon->GetClass()))
+		{
+			OldWeapon->Stash();
+			CachedWeapons.Add(OldWeapon->GetClass(), OldWeapon);
+		}
+		else
+		{
+			OldWeapon->Destroy();
+		}
+
 		EquippedWeapon = nullptr;
-		OnRep_EquippedWeapon();
+		OnRep_EquippedWeapon(OldWeapon);
 	}
 }
 
@@ -991,8 +1188,14 @@ void AMainCharacter::OnRep_Thirst(float OldThirst)
 	OnThirstModified(Thirst - OldThirst);
 }
 
-void AMainCharacter::OnRep_EquippedWeapon()
+void AMainCharacter::OnRep_EquippedWeapon(class AWeapon* OldWeapon)
 {
+	// the server unequips in UnEquipWeapon, clients keep put away weapons now so they need to stop them here
+	if (!HasAuthority() && IsValid(OldWeapon) && OldWeapon != EquippedWeapon)
+	{
+		OldWeapon->OnUnEquip();
+	}
+
 	if (EquippedWeapon)
 	{
 		EquippedWeapon->OnEquip();
@@ -1285,20 +1488,128 @@ bool AMainCharacter::ServerDropItem_Validate(class UBaseItem* Item, const int32
 }
 
 // start interact on server
-void AMainCharacter::ServerBeginInteract_Implementation() 
+void AMainCharacter::ServerBeginInteract_Implementation(UInteractionComponent* Target) 
 {
+	// a new press replaces one still waiting on the trace budget
+	GetWorldTimerManager().ClearTimer(TimerHandle_DeferredInteract);
+	DeferredInteractTarget.Reset();
+
+	BeginInteractWithTarget(Target, true);
+}
+
+void AMainCharacter::BeginInteractWithTarget(UInteractionComponent* Target, const bool bCanDefer) 
+{
+	bool bOutOfBudget = false;
+	const bool bValidTarget = ValidateInteractTarget(Target, bOutOfBudget);
+
+	// never accept a target that wasn't traced, wait for the budget to reset next frame instead
+	if (bOutOfBudget && bCanDefer)
+	{
+		DeferredInteractTarget = Target;
+		TimerHandle_DeferredInteract = GetWorldTimerManager().SetTimerForNextTick(this, &AMainCharacter::DeferredBeginInteract);
+		return;
+	}
+
+	// focus on the clients target if it checks out, otherwise drop whatever was focused
+	if (bValidTarget)
+	{
+		if (Target != GetInteractable())
+		{
+			FoundNewInteractable(Target);
+		}
+	}
+	else
+	{
+		NoFoundInteractable();
+	}
+
 	BeginInteract();
 }
 
+void AMainCharacter::DeferredBeginInteract() 
+{
+	UInteractionComponent* Target = DeferredInteractTarget.Get();
+	DeferredInteractTarget.Reset();
+
+	// still out of budget, the target is rejected this time
+	BeginInteractWithTarget(Target, false);
+}
+
 // check interact on server
-bool AMainCharacter::ServerBeginInteract_Validate() 
+bool AMainCharacter::ServerBeginInteract_Validate(UInteractionComponent* Target) 
 {
+	// no target is fine, the client pressed interact while looking at nothing
 	return true;
 }
 
+bool AMainCharacter::ValidateInteractTarget(UInteractionComponent* Target, bool& bOutOfBudget) 
+{
+	if (!Target || !Target->IsActive() || !Target->GetOwner() || Target->GetOwner() == this || !GetController())
+	{
+		return false;
+	}
+
+	FVector EyesLoc;
+	FRotator EyesRot;
+	GetController()->GetPlayerViewPoint(EyesLoc, EyesRot);
+
+	// close enough to the target
+	const FVector ToTarget = Target->GetComponentLocation() - EyesLoc;
+	const float Distance = ToTarget.Size();
+	if (Distance > Target->InteractionDistance + InteractionValidationLeeway)
+	{
+		return false;
+	}
+
+	// roughly looking at the target, anything the player is standing on top of counts as in view
+	if (Distance > InteractionValidationLeeway)
+	{
+		const float CosAngle = FVector::DotProduct(ToTarget / Distance, EyesRot.Vector());
+		if (CosAngle < FMath::Cos(FMath::DegreesToRadians(InteractionValidationAngle)))
+		{
+			return false;
+		}
+	}
+
+	// reuse the last occlusion result while it is for the same target, recent and from about the same place
+	const float Now = GetWorld()->GetTimeSeconds();
+	const bool bCacheFresh = ValidatedInteractable.Get() == Target && Now - ValidatedTime <= InteractionValidationCacheTime
+		&& FVector::DistSquared(ValidatedViewLocation, EyesLoc) <= FMath::Square(InteractionValidationLeeway);
+
+	if (bCacheFresh)
+	{
+		return bValidatedVisible;
+	}
+
+	UInteractionSubsystem* Interactions = GetWorld()->GetSubsystem<UInteractionSubsystem>();
+	bool bVisible = true;
+	if (!Interactions)
+	{
+		return false;
+	}
+
+	if (!Interactions->CheckVisibility(EyesLoc, Target, this, bVisible))
+	{
+		// out of trace budget this frame and nothing fresh cached, the target can't be trusted yet
+		bOutOfBudget = true;
+		return false;
+	}
+
+	ValidatedInteractable = Target;
+	ValidatedViewLocation = EyesLoc;
+	ValidatedTime = Now;
+	bValidatedVisible = bVisible;
+
+	return bVisible;
+}
+
 // stop interact on server
 void AMainCharacter::ServerEndInteract_Implementation() 
 {
+	// released before a deferred begin interact ran
+	GetWorldTimerManager().ClearTimer(TimerHandle_DeferredInteract);
+	DeferredInteractTarget.Reset();
+
 	EndInteract();
 }
 
@@ -22,6 +22,10 @@ struct FInteractionData
 		ViewedInteractionComponent = nullptr;
 		LastInteractionCheckTime = 0.f;
 		bInteractHeld = false;
+		LastCheckLocation = FVector::ZeroVector;
+		LastCheckDirection = FVector::ZeroVector;
+		LastCheckTargetLocation = FVector::ZeroVector;
+		LastCheckChangeStamp = 0;
 	}
 
 	// stores the interactable component that player is looking at
@@ -36,6 +40,21 @@ struct FInteractionData
 	// checks if the player is holding the interact button
 	UPROPERTY()
 	bool bInteractHeld;
+
+	// view location and direction of the last interaction check, a new check only runs once the view has moved past a threshold
+	UPROPERTY()
+	FVector LastCheckLocation;
+
+	UPROPERTY()
+	FVector LastCheckDirection;
+
+	// where the focused interactable was on the last check
+	UPROPERTY()
+	FVector LastCheckTargetLocation;
+
+	// interaction grid change stamp around the player on the last check
+	UPROPERTY()
+	uint32 LastCheckChangeStamp;
 };
 
 // delegate for updating UI when an item is equipped, takes slot and item
@@ -66,6 +85,10 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Components")
 	class UInteractionComponent* LootPlayerInteraction;
 
+	// server side record of where the characters hitboxes were, used to validate hits from lagging clients
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Components")
+	class UHitboxHistoryComponent* HitboxHistory;
+
 	// create springarm, responsible for keeping 3rd person camera from clipping into walls
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Camera, meta = (AllowPrivateAccess = "true"))
 	class USpringArmComponent* SpringArmComponent;
@@ -108,6 +131,9 @@ protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 
+	// destroys the weapons this character has put away
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 	// array of replicated props
 	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
 
@@ -164,14 +190,49 @@ public:
 	UFUNCTION(Server, Reliable, WithValidation)
 	void ServerLootItem(class UBaseItem* ItemToLoot);
 
-	// how often in seconds to check for an interactable object. 0 means every tick
+	// client asking to loot several items at once, one server call for the whole selection
+	UFUNCTION(BlueprintCallable, Category = "Looting")
+	void LootItems(const TArray<class UBaseItem*>& ItemsToGive);
+
+	// client asking to loot everything from the loot source
+	UFUNCTION(BlueprintCallable, Category = "Looting")
+	void LootAllItems();
+
+	// server moving the selected items from the loot source
+	UFUNCTION(Server, Reliable, WithValidation)
+	void ServerLootItems(const TArray<class UBaseItem*>& ItemsToLoot);
+
+	// server moving every item from the loot source
+	UFUNCTION(Server, Reliable, WithValidation)
+	void ServerLootAllItems();
+
+	// min time in seconds between checks for an interactable object. 0 means every tick
 	UPROPERTY(EditDefaultsOnly, Category = "Interaction")
 	float InteractionCheckFrequency;
 
-	// how far to trace for an interactable object
+	// how far to look for an interactable object
 	UPROPERTY(EditDefaultsOnly, Category = "Interaction")
 	float InteractionCheckDistance;
 
+	// half angle in degrees of the view cone an interactable has to be in to be found
+	UPROPERTY(EditDefaultsOnly, Category = "Interaction", meta = (ClampMin = 0.0, ClampMax = 90.0))
+	float InteractionConeAngle;
+
+	// how far the view has to move before checking for an interactable object again
+	UPROPERTY(EditDefaultsOnly, Category = "Interaction")
+	float InteractionCheckMoveThreshold;
+
+	// how far in degrees the view has to turn before checking for an interactable object again
+	UPROPERTY(EditDefaultsOnly, Category = "Interaction")
+	float InteractionCheckRotationThreshold;
+
+	// how often in seconds to check for an interactable object when nothing has changed, catches doors and other things moving in the way. 0 to never check
+	UPROPERTY(EditDefaultsOnly, Category = "Interaction")
+	float InteractionCheckFallbackInterval;
+
+	// whether anything changed since the last interaction check that could change what the player is looking at
+	bool ShouldPerformInteractionCheck() const;
+
 	// checks if theres an interactable item in view
 	void PerformInteractionCheck();
 
@@ -185,8 +246,9 @@ public:
 
 	// RPC call to server for player pushing interact button
 	// reliable forces the client to send up to the server
+	// the client sends what it is looking at, the server checks it instead of redoing the interaction check
 	UFUNCTION(Server, Reliable, WithValidation)
-	void ServerBeginInteract();
+	void ServerBeginInteract(class UInteractionComponent* Target);
 
 	UFUNCTION(Server, Reliable, WithValidation)
 	void ServerEndInteract();
@@ -204,6 +266,38 @@ public:
 	// create a timer handle to keep track of players interaction time
 	FTimerHandle TimerHandle_Interact;
 
+	// [server] checks a client could be interacting with an interactable using its distance, view angle and a cached occlusion result
+	// bOutOfBudget is set when the occlusion trace couldn't run this frame, the target is rejected in that case
+	bool ValidateInteractTarget(class UInteractionComponent* Target, bool& bOutOfBudget);
+
+	// [server] validates the clients target and begins interacting, waits a frame once if the occlusion trace budget is used up
+	void BeginInteractWithTarget(class UInteractionComponent* Target, const bool bCanDefer);
+
+	// [server] retries a begin interact that was waiting on the trace budget
+	void DeferredBeginInteract();
+
+	// [server] begin interact waiting for next frames trace budget
+	FTimerHandle TimerHandle_DeferredInteract;
+	TWeakObjectPtr<class UInteractionComponent> DeferredInteractTarget;
+
+	// [server] extra distance allowed past an interactables interaction distance, also how far the player can move before the cached occlusion result is redone
+	UPROPERTY(EditDefaultsOnly, Category = "Interaction")
+	float InteractionValidationLeeway;
+
+	// [server] half angle in degrees of the view cone a clients interact target has to be in, wider than the client cone to cover view rotation lag
+	UPROPERTY(EditDefaultsOnly, Category = "Interaction", meta = (ClampMin = 0.0, ClampMax = 180.0))
+	float InteractionValidationAngle;
+
+	// [server] how long in seconds an occlusion result for a clients interact target is reused
+	UPROPERTY(EditDefaultsOnly, Category = "Interaction")
+	float InteractionValidationCacheTime;
+
+	// [server] last occlusion result for a clients interact target
+	TWeakObjectPtr<class UInteractionComponent> ValidatedInteractable;
+	FVector ValidatedViewLocation;
+	float ValidatedTime;
+	bool bValidatedVisible;
+
 public:
 	
 	// store if currently interacting
@@ -373,7 +467,15 @@ protected:
 	class AWeapon* EquippedWeapon;
 
 	UFUNCTION()
-	void OnRep_EquippedWeapon();
+	void OnRep_EquippedWeapon(class AWeapon* OldWeapon);
+
+	// [server] weapons this character has put away, reused instead of spawning a new weapon the next time the same class is equipped
+	UPROPERTY(Transient)
+	TMap<TSubclassOf<class AWeapon>, class AWeapon*> CachedWeapons;
+
+	// max weapons kept in CachedWeapons, weapons put away once it's full are destroyed
+	UPROPERTY(EditDefaultsOnly, Category = "Weapons", meta = (ClampMin = 0))
+	int32 MaxCachedWeapons;
 
 	// called when left mouse button is pressed
 	void StartFire();
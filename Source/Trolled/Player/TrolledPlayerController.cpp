@@ -4,10 +4,15 @@
 #include "TrolledPlayerController.h"
 #include "Trolled/MainCharacter.h"
 #include "Trolled/Framework/TrolledGameStateBase.h"
+#include "Trolled/Components/InteractionComponent.h"
+#include "Trolled/Widgets/InteractionWidget.h"
 #include "Kismet/GameplayStatics.h"
 
 ATrolledPlayerController::ATrolledPlayerController() 
 {
+    InteractionPrompt = nullptr;
+    bWarnedMissingPromptClass = false;
+    DefaultInteractionPromptClass = FSoftClassPath(TEXT("/Game/UserInterface/Widgets/WBP_InteractionCard.WBP_InteractionCard_C"));
 }
 
 void ATrolledPlayerController::BeginPlay() 
@@ -32,6 +37,106 @@ void ATrolledPlayerController::SetupInputComponent()
 	InputComponent->BindAction("Reload", IE_Pressed, this, &ATrolledPlayerController::StartReload);
 }
 
+void ATrolledPlayerController::PlayerTick(float DeltaTime) 
+{
+    Super::PlayerTick(DeltaTime);
+
+    // keep following the interactable while it is focused, even if it is off screen right now
+    if (InteractionPrompt && !PromptInteractable.IsExplicitlyNull())
+    {
+        UpdateInteractionPromptPosition();
+    }
+}
+
+void ATrolledPlayerController::ShowInteractionPrompt(UInteractionComponent* Interactable) 
+{
+    if (!Interactable || !IsLocalController())
+    {
+        return;
+    }
+
+    if (!InteractionPromptClass)
+    {
+        InteractionPromptClass = DefaultInteractionPromptClass.TryLoadClass<UInteractionWidget>();
+    }
+
+    if (!InteractionPromptClass && !bWarnedMissingPromptClass)
+    {
+        bWarnedMissingPromptClass = true;
+        UE_LOG(LogTemp, Warning, TEXT("%s has no InteractionPromptClass and DefaultInteractionPromptClass %s didn't load, interaction prompts won't show"), *GetName(), *DefaultInteractionPromptClass.ToString());
+    }
+
+    // create the prompt the first time it is needed, it is reused for every interactable after that
+    if (!InteractionPrompt && InteractionPromptClass)
+    {
+        InteractionPrompt = CreateWidget<UInteractionWidget>(this, InteractionPromptClass);
+        if (InteractionPrompt)
+        {
+            // centered on the interactable like the old screen space widget components
+            InteractionPrompt->SetAlignmentInViewport(FVector2D(0.5f, 0.5f));
+            InteractionPrompt->AddToViewport();
+        }
+    }
+
+    if (!InteractionPrompt)
+    {
+        return;
+    }
+
+    PromptInteractable = Interactable;
+    InteractionPrompt->UpdateInteractionWidget(Interactable);
+    UpdateInteractionPromptPosition();
+}
+
+void ATrolledPlayerController::HideInteractionPrompt(UInteractionComponent* Interactable) 
+{
+    // another interactable may already have taken over the prompt
+    if (PromptInteractable.Get() != Interactable)
+    {
+        return;
+    }
+
+    PromptInteractable.Reset();
+
+    if (InteractionPrompt)
+    {
+        InteractionPrompt->SetVisibility(ESlateVisibility::Collapsed);
+    }
+}
+
+void ATrolledPlayerController::RefreshInteractionPrompt(UInteractionComponent* Interactable) 
+{
+    if (InteractionPrompt && Interactable && PromptInteractable.Get() == Interactable)
+    {
+        InteractionPrompt->UpdateInteractionWidget(Interactable);
+    }
+}
+
+void ATrolledPlayerController::UpdateInteractionPromptPosition() 
+{
+    UInteractionComponent* Interactable = PromptInteractable.Get();
+
+    // the interactable was destroyed or turned off while focused
+    if (!Interactable || !Interactable->IsActive())
+    {
+        PromptInteractable.Reset();
+        InteractionPrompt->SetVisibility(ESlateVisibility::Collapsed);
+        return;
+    }
+
+    // collapse the prompt while the interactable is behind the camera
+    FVector2D ScreenLocation;
+    if (ProjectWorldLocationToScreen(Interactable->GetComponentLocation(), ScreenLocation, true))
+    {
+        InteractionPrompt->SetPositionInViewport(ScreenLocation);
+        InteractionPrompt->SetVisibility(ESlateVisibility::HitTestInvisible);
+    }
+    else
+    {
+        InteractionPrompt->SetVisibility(ESlateVisibility::Collapsed);
+    }
+}
+
 void ATrolledPlayerController::Respawn() 
 {
     // unpossess the controller from the current character
@@ -180,3 +285,22 @@ void ATrolledPlayerController::ClientShowNotification_Implementation(const FText
 {
     ShowNotification(Message);
 }
+
+void ATrolledPlayerController::DumpWeaponNetStats() 
+{
+    // counters are only tracked on the server
+    if (!HasAuthority())
+    {
+        ServerDumpWeaponNetStats();
+        return;
+    }
+
+    UE_LOG(LogTemp, Log, TEXT("%s weapon RPCs: per shot %d RPCs %lld bytes, batched %d RPCs %d shots %lld bytes, rejected %d shots %d hits"), *GetName(),
+        WeaponNetStats.PerShotRPCs, WeaponNetStats.PerShotBytes, WeaponNetStats.BatchedRPCs, WeaponNetStats.BatchedShots, WeaponNetStats.BatchedBytes,
+        WeaponNetStats.RejectedShots, WeaponNetStats.RejectedHits);
+}
+
+void ATrolledPlayerController::ServerDumpWeaponNetStats_Implementation() 
+{
+    DumpWeaponNetStats();
+}
@@ -4,12 +4,65 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/PlayerController.h"
+#include "Trolled/Weapons/Weapon.h"
 #include "TrolledPlayerController.generated.h"
 
+// weapon RPC counters for one connection, used to compare the batched shot path against the per shot RPCs
+USTRUCT(BlueprintType)
+struct FWeaponNetStats
+{
+	GENERATED_BODY()
+
+	FWeaponNetStats()
+	{
+		PerShotRPCs = 0;
+		PerShotBytes = 0;
+		BatchedRPCs = 0;
+		BatchedBytes = 0;
+		BatchedShots = 0;
+		RejectedShots = 0;
+		RejectedHits = 0;
+		RejectionsSinceLog = 0;
+		LastRejectionLogTime = -1.f;
+	}
+
+	// ServerHandleFiring and ServerHandleHit calls received
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Net")
+	int32 PerShotRPCs;
+
+	// payload bytes received in the per shot RPCs
+	UPROPERTY(VisibleAnywhere, Category = "Net")
+	int64 PerShotBytes;
+
+	// ServerHandleShots calls received
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Net")
+	int32 BatchedRPCs;
+
+	// payload bytes received in the batched RPCs
+	UPROPERTY(VisibleAnywhere, Category = "Net")
+	int64 BatchedBytes;
+
+	// shots received in the batched RPCs
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Net")
+	int32 BatchedShots;
+
+	// shots the server dropped for being faster than the fire rate or not matching a shot that was fired
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Net")
+	int32 RejectedShots;
+
+	// hits the server dropped after rewinding the hit player
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Net")
+	int32 RejectedHits;
+
+	// rejections since the last time they were logged, the log is rate limited so a cheating or lagging client can't flood it
+	int32 RejectionsSinceLog;
+	float LastRejectionLogTime;
+};
+
 /**
  * 
  */
-UCLASS()
+UCLASS(Config=Game)
 class TROLLED_API ATrolledPlayerController : public APlayerController
 {
 	GENERATED_BODY()
@@ -27,6 +80,9 @@ protected:
 	virtual void BeginPlay() override;
 	virtual void SetupInputComponent() override;
 
+	// keeps the interaction prompt over the focused interactable
+	virtual void PlayerTick(float DeltaTime) override;
+
 public:
 	// Blueprint Implementable allows functions to be constructed here
 	// but implemented in BP's so the two can both control the functions
@@ -95,4 +151,49 @@ public:
 	// allows reload if alive, otherwise respawn
 	void StartReload();
 
+	// widget used for the interaction prompt, one is created per local player and moved to whatever they focus on
+	// falls back to DefaultInteractionPromptClass when not set on the blueprint
+	UPROPERTY(EditDefaultsOnly, Category = "Interaction")
+	TSubclassOf<class UInteractionWidget> InteractionPromptClass;
+
+	// prompt widget used when InteractionPromptClass isn't set, override under [/Script/Trolled.TrolledPlayerController] in DefaultGame.ini
+	UPROPERTY(Config)
+	FSoftClassPath DefaultInteractionPromptClass;
+
+	// [client] shows the interaction prompt over an interactable the player started focusing on
+	void ShowInteractionPrompt(class UInteractionComponent* Interactable);
+
+	// [client] hides the interaction prompt if it is showing this interactable
+	void HideInteractionPrompt(class UInteractionComponent* Interactable);
+
+	// [client] updates the prompt text if it is showing this interactable
+	void RefreshInteractionPrompt(class UInteractionComponent* Interactable);
+
+	// [server] weapon RPC counters for this connection
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Net")
+	FWeaponNetStats WeaponNetStats;
+
+	// prints the weapon RPC counters for this connection to the log
+	UFUNCTION(Exec)
+	void DumpWeaponNetStats();
+
+	// asks the server to log its counters for this connection
+	UFUNCTION(Server, Reliable)
+	void ServerDumpWeaponNetStats();
+
+private:
+
+	// projects the focused interactable onto the screen and moves the prompt there, hidden while it is off screen
+	void UpdateInteractionPromptPosition();
+
+	// the interaction prompt, created the first time the player focuses on something
+	UPROPERTY()
+	class UInteractionWidget* InteractionPrompt;
+
+	// interactable the prompt is showing
+	TWeakObjectPtr<class UInteractionComponent> PromptInteractable;
+
+	// the missing prompt class is only logged the first time a prompt is needed
+	bool bWarnedMissingPromptClass;
+
 };
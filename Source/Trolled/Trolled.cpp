@@ -3,5 +3,7 @@
 #include "Trolled.h"
 #include "Modules/ModuleManager.h"
 
+CSV_DEFINE_CATEGORY_MODULE(TROLLED_API, TrolledWeapon, true);
+
 IMPLEMENT_PRIMARY_GAME_MODULE( FDefaultGameModuleImpl, Trolled, "Trolled" );
  
\ No newline at end of file
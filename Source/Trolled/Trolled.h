@@ -3,6 +3,35 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "ProfilingDebugging/CsvProfiler.h"
 
 // Implement the custom collision channel for weapons
-#define COLLISION_WEAPON ECC_GameTraceChannel1
\ No newline at end of file
+#define COLLISION_WEAPON ECC_GameTraceChannel1
+
+// stat group for weapon and combat timings, view in game with "stat TrolledWeapon"
+DECLARE_STATS_GROUP(TEXT("TrolledWeapon"), STATGROUP_TrolledWeapon, STATCAT_Advanced);
+
+// stat group for inventory replication and lookups, view in game with "stat TrolledInventory"
+DECLARE_STATS_GROUP(TEXT("TrolledInventory"), STATGROUP_TrolledInventory, STATCAT_Advanced);
+
+// stat group for interaction checks, view in game with "stat TrolledInteraction"
+DECLARE_STATS_GROUP(TEXT("TrolledInteraction"), STATGROUP_TrolledInteraction, STATCAT_Advanced);
+
+// peeks the length prefix of the FString the reader is at and checks it fits in the bytes left, the reader doesn't move
+// check before reading strings from saved data, a corrupt length would otherwise allocate whatever it claims
+inline bool IsStringLengthInBounds(FArchive& Reader)
+{
+	const int64 Start = Reader.Tell();
+	int32 SaveNum = 0;
+	Reader << SaveNum;
+	const int64 BytesLeft = Reader.TotalSize() - Reader.Tell();
+	Reader.Seek(Start);
+
+	// negative lengths are UTF-16, two bytes a character
+	const int64 NumBytes = SaveNum < 0 ? -(int64)SaveNum * 2 : (int64)SaveNum;
+	return !Reader.IsError() && NumBytes <= BytesLeft;
+}
+
+// csv category for the same timings, written with csvprofile or the weapon load test
+CSV_DECLARE_CATEGORY_MODULE_EXTERN(TROLLED_API, TrolledWeapon);
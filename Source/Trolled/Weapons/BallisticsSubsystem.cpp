@@ -0,0 +1,273 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "BallisticsSubsystem.h"
+#include "Trolled/Trolled.h"
+#include "Trolled/Weapons/Weapon.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+
+DECLARE_CYCLE_STAT(TEXT("Ballistics Tick"), STAT_BallisticsTick, STATGROUP_TrolledWeapon);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Ballistics Traces"), STAT_BallisticsTraces, STATGROUP_TrolledWeapon);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Bullets In Flight"), STAT_BallisticsBullets, STATGROUP_TrolledWeapon);
+
+#if !UE_BUILD_SHIPPING
+// runs headless on a dedicated server, e.g. -nullrhi -ExecCmds="Trolled.BallisticsBenchmark 10000 30"
+static FAutoConsoleCommandWithWorldAndArgs BallisticsBenchmarkCommand(
+	TEXT("Trolled.BallisticsBenchmark"),
+	TEXT("Steps ownerless bullets with blocking traces and logs the cost per step. Clears every bullet in flight. Usage: Trolled.BallisticsBenchmark [NumBullets=10000] [NumSteps=30]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic([](const TArray<FString>& Args, UWorld* World)
+	{
+		if (UBallisticsSubsystem* Ballistics = World ? World->GetSubsystem<UBallisticsSubsystem>() : nullptr)
+		{
+			const int32 NumBullets = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 10000;
+			const int32 NumSteps = Args.Num() > 1 ? FCString::Atoi(*Args[1]) : 30;
+
+			// a 30hz server step
+			Ballistics->RunBenchmark(FMath::Max(NumBullets, 1), FMath::Max(NumSteps, 1), 1.f / 30.f);
+		}
+	}));
+#endif
+
+void UBallisticsSubsystem::Deinitialize()
+{
+	ClearBullets();
+
+	Super::Deinitialize();
+}
+
+void UBallisticsSubsystem::Tick(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_BallisticsTick);
+
+	// hits from the steps traced last tick
+	ResolveBulletTraces();
+	RemoveDeadBullets();
+
+	StepBullets(GetWorld()->GetTimeSeconds(), bAsyncBulletTraces);
+
+	SET_DWORD_STAT(STAT_BallisticsBullets, Positions.Num());
+}
+
+bool UBallisticsSubsystem::IsTickable() const
+{
+	// the class default object is registered as a tickable too
+	return !IsTemplate() && Positions.Num() > 0;
+}
+
+TStatId UBallisticsSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UBallisticsSubsystem, STATGROUP_Tickables);
+}
+
+void UBallisticsSubsystem::FireBullet(AWeapon* Weapon, const FVector& Origin, const FVector& Velocity, const float Drag, const float GravityZ, const float Lifetime, const float FireTime, const uint16 ShotIndex, const uint8 PelletIndex)
+{
+	AddBullet(Weapon, Origin, Velocity, Drag, GravityZ, Lifetime, FireTime, ShotIndex, PelletIndex);
+}
+
+int32 UBallisticsSubsystem::AddBullet(AWeapon* Weapon, const FVector& Origin, const FVector& Velocity, const float Drag, const float GravityZ, const float Lifetime, const float FireTime, const uint16 ShotIndex, const uint8 PelletIndex)
+{
+	Positions.Add(Origin);
+	Velocities.Add(Velocity);
+	Drags.Add(Drag);
+	Gravities.Add(GravityZ);
+	Owners.Add(Weapon);
+	SpawnTimes.Add(FireTime);
+	Lifetimes.Add(Lifetime);
+
+	// the first step starts from when the bullet was fired, not from the start of the frame
+	SimTimes.Add(FireTime);
+	ShotIds.Add((uint32)ShotIndex | ((uint32)PelletIndex << 16));
+
+	SegmentStarts.Add(Origin);
+	SegmentStartTimes.Add(FireTime);
+	TraceHandles.AddDefaulted();
+	return DeadBullets.Add(false);
+}
+
+void UBallisticsSubsystem::StepBullets(const float Now, const bool bAsyncTraces)
+{
+	UWorld* World = GetWorld();
+	const int32 NumBullets = Positions.Num();
+	int32 NumTraces = 0;
+
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(BulletTrace));
+
+	// the surface picks the impact effect
+	QueryParams.bReturnPhysicalMaterial = true;
+
+	for (int32 i = 0; i < NumBullets; ++i)
+	{
+		if (DeadBullets[i])
+		{
+			continue;
+		}
+
+		// bullets that ran out of time are removed next tick
+		if (Now - SpawnTimes[i] > Lifetimes[i])
+		{
+			DeadBullets[i] = true;
+			++NumDeadBullets;
+			continue;
+		}
+
+		const float StepTime = Now - SimTimes[i];
+		if (StepTime <= 0.f)
+		{
+			continue;
+		}
+
+		// semi implicit euler, drag slows the bullet in proportion to its speed and gravity pulls it down
+		FVector& Velocity = Velocities[i];
+		Velocity += (FVector(0.f, 0.f, Gravities[i]) - Velocity * Drags[i]) * StepTime;
+
+		SegmentStarts[i] = Positions[i];
+		SegmentStartTimes[i] = SimTimes[i];
+		Positions[i] += Velocity * StepTime;
+		SimTimes[i] = Now;
+
+		// ignore the weapon and whoever is holding it
+		QueryParams.ClearIgnoredActors();
+		if (AWeapon* Weapon = Owners[i].Get())
+		{
+			QueryParams.AddIgnoredActor(Weapon);
+			QueryParams.AddIgnoredActor(Weapon->GetOwner());
+		}
+
+		++NumTraces;
+
+		if (bAsyncTraces)
+		{
+			TraceHandles[i] = World->AsyncLineTraceByChannel(EAsyncTraceType::Single, SegmentStarts[i], Positions[i], COLLISION_WEAPON, QueryParams);
+		}
+		else
+		{
+			FHitResult Hit;
+			if (World->LineTraceSingleByChannel(Hit, SegmentStarts[i], Positions[i], COLLISION_WEAPON, QueryParams))
+			{
+				ReportImpact(i, Hit);
+			}
+		}
+	}
+
+	INC_DWORD_STAT_BY(STAT_BallisticsTraces, NumTraces);
+}
+
+void UBallisticsSubsystem::ResolveBulletTraces()
+{
+	UWorld* World = GetWorld();
+	const int32 NumBullets = Positions.Num();
+
+	for (int32 i = 0; i < NumBullets; ++i)
+	{
+		// bullets fired since the last tick haven't been traced yet
+		if (!TraceHandles[i].IsValid())
+		{
+			continue;
+		}
+
+		FTraceDatum TraceData;
+		if (World->QueryTraceData(TraceHandles[i], TraceData) && TraceData.OutHits.Num() > 0 && TraceData.OutHits[0].bBlockingHit)
+		{
+			ReportImpact(i, TraceData.OutHits[0]);
+		}
+
+		TraceHandles[i] = FTraceHandle();
+	}
+}
+
+void UBallisticsSubsystem::ReportImpact(const int32 BulletIndex, const FHitResult& Hit)
+{
+	if (AWeapon* Weapon = Owners[BulletIndex].Get())
+	{
+		FBulletImpact Impact;
+		Impact.Hit = Hit;
+		Impact.SegmentStart = SegmentStarts[BulletIndex];
+		Impact.Direction = (Positions[BulletIndex] - SegmentStarts[BulletIndex]).GetSafeNormal();
+
+		// the hit time is a fraction along the step, so the impact gets its own time inside the tick
+		Impact.ImpactTime = FMath::Lerp(SegmentStartTimes[BulletIndex], SimTimes[BulletIndex], Hit.Time);
+		Impact.ShotIndex = (uint16)(ShotIds[BulletIndex] & 0xFFFF);
+		Impact.PelletIndex = (uint8)(ShotIds[BulletIndex] >> 16);
+
+		Weapon->OnBulletImpact(Impact);
+	}
+
+	DeadBullets[BulletIndex] = true;
+	++NumDeadBullets;
+}
+
+void UBallisticsSubsystem::RemoveDeadBullets()
+{
+	if (NumDeadBullets == 0)
+	{
+		return;
+	}
+
+	// back to front, so the bullet swapped into each slot has already been checked
+	for (int32 i = Positions.Num() - 1; i >= 0; --i)
+	{
+		if (DeadBullets[i])
+		{
+			Positions.RemoveAtSwap(i, 1, false);
+			Velocities.RemoveAtSwap(i, 1, false);
+			Drags.RemoveAtSwap(i, 1, false);
+			Gravities.RemoveAtSwap(i, 1, false);
+			Owners.RemoveAtSwap(i, 1, false);
+			SpawnTimes.RemoveAtSwap(i, 1, false);
+			Lifetimes.RemoveAtSwap(i, 1, false);
+			SimTimes.RemoveAtSwap(i, 1, false);
+			ShotIds.RemoveAtSwap(i, 1, false);
+			SegmentStarts.RemoveAtSwap(i, 1, false);
+			SegmentStartTimes.RemoveAtSwap(i, 1, false);
+			TraceHandles.RemoveAtSwap(i, 1, false);
+			DeadBullets.RemoveAtSwap(i, 1, false);
+		}
+	}
+
+	NumDeadBullets = 0;
+}
+
+void UBallisticsSubsystem::RunBenchmark(const int32 NumBullets, const int32 NumSteps, const float StepTime)
+{
+	// start from nothing so only the benchmark bullets are measured
+	ClearBullets();
+
+	// spread the bullets around the middle of the map, flying in random directions at rifle speed
+	FRandomStream RandomStream(0);
+	const float GravityZ = GetWorld()->GetGravityZ();
+	const float StartTime = GetWorld()->GetTimeSeconds();
+
+	for (int32 i = 0; i < NumBullets; ++i)
+	{
+		const FVector Origin(RandomStream.FRandRange(-10000.f, 10000.f), RandomStream.FRandRange(-10000.f, 10000.f), RandomStream.FRandRange(100.f, 2000.f));
+		AddBullet(nullptr, Origin, RandomStream.GetUnitVector() * 80000.f, 0.1f, GravityZ, NumSteps * StepTime + 1.f, StartTime, 0, 0);
+	}
+
+	// blocking traces so the time includes the traces themselves
+	double TotalSeconds = 0.0;
+	for (int32 Step = 1; Step <= NumSteps; ++Step)
+	{
+		const double StepStart = FPlatformTime::Seconds();
+		RemoveDeadBullets();
+		StepBullets(StartTime + Step * StepTime, false);
+		TotalSeconds += FPlatformTime::Seconds() - StepStart;
+	}
+
+	const double MsPerStep = TotalSeconds * 1000.0 / NumSteps;
+	UE_LOG(LogTemp, Log, TEXT("Ballistics benchmark: %d bullets, %d steps, %.3f ms per step, %.3f us per bullet step, %d still in flight"), NumBullets, NumSteps, MsPerStep, MsPerStep * 1000.0 / NumBullets, Positions.Num() - NumDeadBullets);
+
+	// benchmark bullets have no owner, clear them so they don't keep ticking
+	ClearBullets();
+}
+
+void UBallisticsSubsystem::ClearBullets()
+{
+	for (int32 i = 0; i < Positions.Num(); ++i)
+	{
+		DeadBullets[i] = true;
+	}
+
+	NumDeadBullets = Positions.Num();
+	RemoveDeadBullets();
+}
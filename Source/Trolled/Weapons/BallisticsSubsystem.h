@@ -0,0 +1,117 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "WorldCollision.h"
+#include "BallisticsSubsystem.generated.h"
+
+class AWeapon;
+
+// a simulated bullet that hit something, passed back to the weapon that fired it
+struct FBulletImpact
+{
+	// what the bullet hit
+	FHitResult Hit;
+
+	// start and normalized direction of the step the bullet hit on
+	FVector SegmentStart;
+	FVector Direction;
+
+	// world time the bullet hit, between the start and end of the step
+	float ImpactTime;
+
+	// shot and pellet the bullet was fired for
+	uint16 ShotIndex;
+	uint8 PelletIndex;
+};
+
+/**
+ * Simulates every bullet in flight for weapons using EWeaponBallistics::Simulated
+ * Bullets are plain data stored as structure of arrays and stepped together once a tick, each step is a swept line trace
+ * from where the bullet was to where it is now. Like the hitscan traces these go through the async trace API and are resolved the next tick
+ */
+UCLASS(Config = Game)
+class TROLLED_API UBallisticsSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+
+	// clears every bullet
+	virtual void Deinitialize() override;
+
+	// FTickableGameObject, steps the bullets
+	virtual void Tick(float DeltaTime) override;
+	virtual bool IsTickable() const override;
+	virtual TStatId GetStatId() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override { return GetWorld(); }
+
+	/** Adds a bullet to the simulation
+	 * @param Weapon weapon that fired the bullet, gets OnBulletImpact when it hits
+	 * @param Origin where the bullet starts
+	 * @param Velocity starting velocity in cm/s
+	 * @param Drag fraction of its velocity the bullet loses per second
+	 * @param GravityZ downward acceleration of the bullet, usually world gravity times a scale
+	 * @param Lifetime seconds before the bullet is removed if it hasn't hit anything
+	 * @param FireTime world time the bullet was fired at, can be earlier than now for shots that were caught up this frame
+	 * @param ShotIndex shot the bullet belongs to
+	 * @param PelletIndex pellet of the shot */
+	void FireBullet(AWeapon* Weapon, const FVector& Origin, const FVector& Velocity, const float Drag, const float GravityZ, const float Lifetime, const float FireTime, const uint16 ShotIndex, const uint8 PelletIndex);
+
+	// number of bullets in flight
+	FORCEINLINE int32 GetNumBullets() const { return Positions.Num(); }
+
+	// steps NumBullets ownerless bullets NumSteps times with blocking traces and logs the cost. Clears every bullet in flight
+	void RunBenchmark(const int32 NumBullets, const int32 NumSteps, const float StepTime);
+
+	// Whether bullet steps are traced through the async trace API and resolved the next tick, instead of blocking traces
+	UPROPERTY(Config)
+	bool bAsyncBulletTraces = true;
+
+private:
+
+	// moves every bullet forward to Now and traces the step
+	void StepBullets(const float Now, const bool bAsyncTraces);
+
+	// reads the results of the traces sent last tick
+	void ResolveBulletTraces();
+
+	// sends a hit back to the weapon that fired the bullet
+	void ReportImpact(const int32 BulletIndex, const FHitResult& Hit);
+
+	// removes bullets that hit or ran out of time
+	void RemoveDeadBullets();
+
+	// removes every bullet
+	void ClearBullets();
+
+	// adds a bullet to every array
+	int32 AddBullet(AWeapon* Weapon, const FVector& Origin, const FVector& Velocity, const float Drag, const float GravityZ, const float Lifetime, const float FireTime, const uint16 ShotIndex, const uint8 PelletIndex);
+
+	// bullet state, one entry per bullet in every array
+	TArray<FVector> Positions;
+	TArray<FVector> Velocities;
+	TArray<float> Drags;
+	TArray<float> Gravities;
+	TArray<TWeakObjectPtr<AWeapon>> Owners;
+	TArray<float> SpawnTimes;
+	TArray<float> Lifetimes;
+
+	// world time each bullets position is at
+	TArray<float> SimTimes;
+
+	// shot and pellet packed together, ShotIndex | PelletIndex << 16
+	TArray<uint32> ShotIds;
+
+	// the last step of each bullet, kept until its trace is resolved
+	TArray<FVector> SegmentStarts;
+	TArray<float> SegmentStartTimes;
+	TArray<FTraceHandle> TraceHandles;
+
+	// set when a bullet hit or expired, removed at the start of the next step
+	TArray<bool> DeadBullets;
+	int32 NumDeadBullets = 0;
+};
@@ -0,0 +1,52 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "BoneDamageTables.h"
+#include "Trolled/Trolled.h"
+#include "Engine/SkeletalMesh.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Bone Damage Tables Built"), STAT_WeaponBoneDamageTablesBuilt, STATGROUP_TrolledWeapon);
+
+uint32 UBoneDamageTables::HashModifiers(const TMap<FName, float>& Modifiers)
+{
+	// xor of each pair so the order the map was filled in doesn't matter
+	uint32 Hash = Modifiers.Num();
+	for (const TPair<FName, float>& Pair : Modifiers)
+	{
+		Hash ^= HashCombine(GetTypeHash(Pair.Key), GetTypeHash(Pair.Value));
+	}
+	return Hash;
+}
+
+const TArray<float>& UBoneDamageTables::GetTable(const UClass* WeaponClass, const TMap<FName, float>& Modifiers, const uint32 ModifiersHash, const USkeletalMesh* Mesh)
+{
+	const FTableKey Key{ FObjectKey(WeaponClass), FObjectKey(Mesh), ModifiersHash };
+	if (const TArray<float>* DamageTable = Tables.Find(Key))
+	{
+		return *DamageTable;
+	}
+
+	INC_DWORD_STAT(STAT_WeaponBoneDamageTablesBuilt);
+
+	const FReferenceSkeleton& RefSkeleton = Mesh->RefSkeleton;
+	const int32 NumBones = RefSkeleton.GetNum();
+
+	TArray<float>& DamageTable = Tables.Add(Key);
+	DamageTable.SetNumUninitialized(NumBones);
+
+	// parents always come before their children in the ref skeleton, so one pass pushes each modifier down the hierarchy
+	for (int32 BoneIndex = 0; BoneIndex < NumBones; ++BoneIndex)
+	{
+		if (const float* Modifier = Modifiers.Find(RefSkeleton.GetBoneName(BoneIndex)))
+		{
+			DamageTable[BoneIndex] = *Modifier;
+		}
+		else
+		{
+			const int32 ParentIndex = RefSkeleton.GetParentIndex(BoneIndex);
+			DamageTable[BoneIndex] = ParentIndex != INDEX_NONE ? DamageTable[ParentIndex] : 1.f;
+		}
+	}
+
+	return DamageTable;
+}
@@ -0,0 +1,53 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "UObject/ObjectKey.h"
+#include "BoneDamageTables.generated.h"
+
+class USkeletalMesh;
+
+/**
+ * Per world cache of weapon BoneDamageModifiers flattened to one multiplier per bone index, with parents already applied to their children
+ * Tables are shared by every weapon of a class that uses the same modifiers, so equipping or spawning a weapon doesn't rebuild them
+ * Keyed by mesh rather than skeleton as bone indices come from the meshes reference skeleton
+ */
+UCLASS()
+class TROLLED_API UBoneDamageTables : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	// order independent hash of a weapons modifiers, weapons with the class default modifiers get the same hash and share tables
+	static uint32 HashModifiers(const TMap<FName, float>& Modifiers);
+
+	/** Find the damage table for a weapon class and mesh, building it the first time
+	 * @param Modifiers the weapons BoneDamageModifiers, only read when the table is built
+	 * @param ModifiersHash HashModifiers of Modifiers, so instances with overridden modifiers get their own table
+	 * @return one multiplier per bone index of Mesh */
+	const TArray<float>& GetTable(const UClass* WeaponClass, const TMap<FName, float>& Modifiers, const uint32 ModifiersHash, const USkeletalMesh* Mesh);
+
+private:
+
+	struct FTableKey
+	{
+		FObjectKey WeaponClass;
+		FObjectKey Mesh;
+		uint32 ModifiersHash;
+
+		bool operator==(const FTableKey& Other) const
+		{
+			return WeaponClass == Other.WeaponClass && Mesh == Other.Mesh && ModifiersHash == Other.ModifiersHash;
+		}
+
+		friend uint32 GetTypeHash(const FTableKey& Key)
+		{
+			return HashCombine(HashCombine(GetTypeHash(Key.WeaponClass), GetTypeHash(Key.Mesh)), Key.ModifiersHash);
+		}
+	};
+
+	TMap<FTableKey, TArray<float>> Tables;
+};
@@ -9,16 +9,132 @@
 #include "Trolled/Items/WeaponItem.h"
 #include "Trolled/MainCharacter.h"
 #include "Trolled/Items/AmmoItem.h"
+#include "Trolled/Components/HitboxHistoryComponent.h"
+#include "Trolled/Weapons/WeaponFXPool.h"
+#include "Trolled/Weapons/BallisticsSubsystem.h"
+#include "Trolled/Weapons/BoneDamageTables.h"
+#include "GameFramework/GameStateBase.h"
 #include "Components/SkeletalMeshComponent.h"
+#include "Engine/SkeletalMesh.h"
 #include "Components/AudioComponent.h"
 #include "Curves/CurveVector.h"
 #include "Kismet/GameplayStatics.h"
 #include "Particles/ParticleSystemComponent.h"
 #include "Sound/SoundCue.h"
+#include "PhysicalMaterials/PhysicalMaterial.h"
 #include "Net/UnrealNetwork.h"
+#include "UObject/CoreNet.h"
+#include "Engine/NetConnection.h"
 #include "DrawDebugHelpers.h"
 #include "Components/SkeletalMeshComponent.h"
 
+DECLARE_CYCLE_STAT(TEXT("Hit Validation"), STAT_WeaponHitValidation, STATGROUP_TrolledWeapon);
+
+// compare Trace Game Thread with bAsyncWeaponTraces on and off to see the game thread time saved
+DECLARE_CYCLE_STAT(TEXT("Trace Game Thread"), STAT_WeaponTraceGameThread, STATGROUP_TrolledWeapon);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Traces"), STAT_WeaponTraces, STATGROUP_TrolledWeapon);
+
+// shot events are the only per shot data sent to other clients, Shot Events Sent is the total across all clients
+DECLARE_CYCLE_STAT(TEXT("Send Shot Events"), STAT_WeaponSendShotEvents, STATGROUP_TrolledWeapon);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Shot Events Sent"), STAT_WeaponShotEventsSent, STATGROUP_TrolledWeapon);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Shot Events Dropped"), STAT_WeaponShotEventsDropped, STATGROUP_TrolledWeapon);
+
+// the fire path entry points, also written to the TrolledWeapon csv category for the load test
+DECLARE_CYCLE_STAT(TEXT("Handle Firing"), STAT_WeaponHandleFiring, STATGROUP_TrolledWeapon);
+DECLARE_CYCLE_STAT(TEXT("Server Handle Hit"), STAT_WeaponServerHandleHit, STATGROUP_TrolledWeapon);
+DECLARE_CYCLE_STAT(TEXT("Server Handle Shots"), STAT_WeaponServerHandleShots, STATGROUP_TrolledWeapon);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Rejected Shots"), STAT_WeaponRejectedShots, STATGROUP_TrolledWeapon);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Rejected Hits"), STAT_WeaponRejectedHits, STATGROUP_TrolledWeapon);
+
+bool FWeaponShot::NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess)
+{
+	Ar << ShotIndex;
+	Ar << Timestamp;
+
+	bOutSuccess = true;
+
+	// origin to 1 decimal place, direction as a quantized normal
+	bool bVectorSuccess = true;
+	Origin.NetSerialize(Ar, Map, bVectorSuccess);
+	bOutSuccess &= bVectorSuccess;
+	Direction.NetSerialize(Ar, Map, bVectorSuccess);
+	bOutSuccess &= bVectorSuccess;
+
+	// misses are the most common shot, so only send the hit data when there was a hit
+	uint8 bHit = HitActor != nullptr;
+	Ar.SerializeBits(&bHit, 1);
+
+	if (bHit)
+	{
+		UObject* HitObject = HitActor;
+		bOutSuccess &= Map->SerializeObject(Ar, AActor::StaticClass(), HitObject);
+
+		// bone indices are small, pack them. 0 means no bone so INDEX_NONE fits
+		uint32 PackedBone = BoneIndex + 1;
+		Ar.SerializeIntPacked(PackedBone);
+
+		// the impact is only used for effects, whole units is plenty
+		ImpactPoint.NetSerialize(Ar, Map, bVectorSuccess);
+		bOutSuccess &= bVectorSuccess;
+		Ar.SerializeBits(&SurfaceType, 6);
+
+		if (Ar.IsLoading())
+		{
+			HitActor = Cast<AActor>(HitObject);
+			BoneIndex = (int32)PackedBone - 1;
+		}
+	}
+	else if (Ar.IsLoading())
+	{
+		HitActor = nullptr;
+		BoneIndex = INDEX_NONE;
+		ImpactPoint = FVector::ZeroVector;
+		SurfaceType = SurfaceType_Default;
+	}
+
+	// bullet impacts only happen for simulated ballistics
+	uint8 bImpactBit = bImpact;
+	Ar.SerializeBits(&bImpactBit, 1);
+	bImpact = bImpactBit != 0;
+
+	// most weapons only have one pellet, so the index is only sent for the extra pellets
+	uint8 bExtraPellet = PelletIndex != 0;
+	Ar.SerializeBits(&bExtraPellet, 1);
+
+	if (bExtraPellet)
+	{
+		Ar << PelletIndex;
+	}
+	else if (Ar.IsLoading())
+	{
+		PelletIndex = 0;
+	}
+
+	return true;
+}
+
+bool FShotEvent::NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess)
+{
+	// whole units, effects dont need any more than that
+	ImpactPoint.NetSerialize(Ar, Map, bOutSuccess);
+
+	uint8 bHitBit = bHit;
+	Ar.SerializeBits(&bHitBit, 1);
+	bHit = bHitBit != 0;
+
+	// surface types fit in 6 bits, misses dont hit a surface
+	if (bHit)
+	{
+		Ar.SerializeBits(&SurfaceType, 6);
+	}
+	else if (Ar.IsLoading())
+	{
+		SurfaceType = SurfaceType_Default;
+	}
+
+	return true;
+}
+
 // Sets default values
 AWeapon::AWeapon()
 {
@@ -45,6 +161,7 @@ AWeapon::AWeapon()
 	bPendingReload = false;
 	bPendingEquip = false;
 	CurrentState = EWeaponState::Idle;
+	TracerTargetParam = FName("BeamEnd");
 	//AttachSocket = FName("GripPoint");
 	AttachSocket1P = FName("GripPoint");
 	AttachSocket3P = FName("GripPoint");
@@ -57,9 +174,29 @@ AWeapon::AWeapon()
 	RecoilResetSpeed = 5.f;
 	RecoilSpeed = 10.f;
 
+	MaxShotsPerBatch = 32;
+	NextShotIndex = 0;
+
+	FireRateTolerance = 0.1f;
+	MaxShotAge = 1.f;
+	PerShotArrivalLeeway = 0.05f;
+	NextShotTime = 0.f;
+	CurrentShotTime = 0.f;
+	LastServerShotTime = -1.f;
+	bPendingServerStopFire = false;
+	ServerShotRecords.SetNum(32);
+	NextServerShotRecord = 0;
+
+	ShotEventCullDistance = 10000.f;
+	MaxShotEventsPerUpdate = 16;
+	MaxShotEventAge = 0.5f;
+	BoneDamageModifiersHash = 0;
+	LastShotFlushTime = 0.f;
+
 	// setup tick and replication
+	// ticks last so automatic fire uses this frames aim and the shots are flushed before the net driver sends the frame
 	PrimaryActorTick.bCanEverTick = true;
-	PrimaryActorTick.TickGroup = TG_PrePhysics;
+	PrimaryActorTick.TickGroup = TG_PostUpdateWork;
 	bReplicates = true;
 
 	// weapon is relevant as long as the current player is relevant
@@ -82,8 +219,37 @@ void AWeapon::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeP
 	DOREPLIFETIME_CONDITION(AWeapon, BurstCounter, COND_SkipOwner);
 	DOREPLIFETIME_CONDITION(AWeapon, bPendingReload, COND_SkipOwner);
 	
-	// COND_InitialOnly only replicates the weapon once to cut net traffic
-	DOREPLIFETIME_CONDITION(AWeapon, BaseItem, COND_InitialOnly);
+	// stashed weapons are reused for other items of the same class, so the item has to replicate when it changes
+	DOREPLIFETIME(AWeapon, BaseItem);
+
+	// the shooter plays its own tracers and impacts
+	DOREPLIFETIME_CONDITION(AWeapon, ShotEventBatch, COND_SkipOwner);
+}
+
+void AWeapon::PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker)
+{
+	Super::PreReplication(ChangedPropertyTracker);
+
+	if (PendingShotEvents.Num() == 0)
+	{
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_WeaponSendShotEvents);
+
+	// the net driver only sends the batch to connections the weapon is relevant to, so far away clients get nothing
+	++ShotEventBatch.BatchId;
+	ShotEventBatch.ServerTime = GetWorld()->GetTimeSeconds();
+	ShotEventBatch.Events = MoveTemp(PendingShotEvents);
+	PendingShotEvents.Reset();
+
+	INC_DWORD_STAT_BY(STAT_WeaponShotEventsSent, ShotEventBatch.Events.Num());
+
+	// the listen server host doesn't get the rep notify, it plays other players shots here
+	if (GetNetMode() == NM_ListenServer && !(PawnOwner && PawnOwner->IsLocallyControlled()))
+	{
+		SimulateShotEvents(ShotEventBatch.Events);
+	}
 }
 
 // in video, not final code
@@ -95,6 +261,16 @@ void AWeapon::PostInitializeComponents()
 	//DetachMeshFromPawn();
 }
 
+#if WITH_EDITOR
+void AWeapon::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
+{
+	Super::PostEditChangeProperty(PropertyChangedEvent);
+
+	// edited modifiers hash differently, so they get their own tables the next time each mesh is hit
+	BoneDamageModifiersHash = UBoneDamageTables::HashModifiers(HitScanConfig.BoneDamageModifiers);
+}
+#endif
+
 // Called when the game starts or when spawned
 void AWeapon::BeginPlay()
 {
@@ -105,6 +281,8 @@ void AWeapon::BeginPlay()
 	{
 		PawnOwner = Cast<AMainCharacter>(GetOwner());
 	}
+
+	BoneDamageModifiersHash = UBoneDamageTables::HashModifiers(HitScanConfig.BoneDamageModifiers);
 }
 
 void AWeapon::Destroyed()
@@ -115,6 +293,47 @@ void AWeapon::Destroyed()
 	StopSimulatingWeaponFire();
 }
 
+void AWeapon::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	// hits from the traces sent last frame
+	if (InFlightTraces.Num() > 0)
+	{
+		ResolveWeaponTraces();
+	}
+
+	// fire any shots that came due since the last frame
+	if (NextShotTime > 0.f)
+	{
+		ProcessScheduledShots();
+	}
+
+	// trace everything fired this frame in one go
+	if (PendingTraces.Num() > 0)
+	{
+		SubmitWeaponTraces();
+	}
+
+	// send the queued shots once per net update of the owner so each RPC carries several shots, or straight away once a full batch is waiting
+	if (PendingShots.Num() > 0)
+	{
+		const float FlushFrequency = PawnOwner ? PawnOwner->NetUpdateFrequency : NetUpdateFrequency;
+		if (PendingShots.Num() >= MaxShotsPerBatch || GetWorld()->TimeSince(LastShotFlushTime) >= 1.f / FlushFrequency)
+		{
+			FlushPendingShots();
+		}
+	}
+
+	// stop firing on the server once the last shots have been sent
+	if (bPendingServerStopFire && PendingTraces.Num() == 0 && InFlightTraces.Num() == 0)
+	{
+		bPendingServerStopFire = false;
+		FlushPendingShots();
+		ServerStopFire();
+	}
+}
+
 // uses ammo from the current mag
 void AWeapon::UseMagAmmo()
 {
@@ -142,9 +361,8 @@ void AWeapon::ConsumeAmmo(const int32 Amount)
 	}
 }
 
-// not sure if I understand this properly - video states on unequip of weapon, ammo is returned to inventory
-// may need to adjust so that the ammo stays in the weapon itself, so that on unequip/reequip the same number of bullets are in the gun
-// otherwise if inventory full and unequip weapon, ammo may fall on the ground or if unequip/reequip the gun may be at full ammo without a reload
+// on unequip the magazine is emptied back into the inventory, a put away weapon is kept around now so the rounds have to leave the magazine
+// whatever doesn't fit in the inventory stays in the magazine instead of being lost
 void AWeapon::ReturnAmmoToInventory()
 {
 	//When the weapon is unequipped, try return the players ammo to their inventory
@@ -156,8 +374,9 @@ void AWeapon::ReturnAmmoToInventory()
 			// get player inventory
 			if (UInventoryComponent* Inventory = PawnOwner->PlayerInventory)
 			{
-				// add ammo
-				Inventory->TryAddItemFromClass(WeaponConfig.AmmoClass, CurrentAmmoInMag);
+				// add ammo, and take out of the magazine only what was added
+				const FItemAddResult AddResult = Inventory->TryAddItemFromClass(WeaponConfig.AmmoClass, CurrentAmmoInMag);
+				CurrentAmmoInMag -= AddResult.ActualAmountGiven;
 			}
 		}
 	}
@@ -212,6 +431,11 @@ void AWeapon::OnEquipFinished()
 void AWeapon::OnUnEquip()
 {
 	bIsEquipped = false;
+
+	// traces still in flight belong to the weapon being put away, drop them so StopFire tells the server straight away
+	PendingTraces.Reset();
+	InFlightTraces.Reset();
+
 	StopFire();
 
 	if (bPendingReload)
@@ -235,6 +459,25 @@ void AWeapon::OnUnEquip()
 	DetermineWeaponState();
 }
 
+void AWeapon::Stash()
+{
+	// hide and detach so the weapon costs nothing while put away
+	DetachFromActor(FDetachmentTransformRules::KeepWorldTransform);
+	SetActorHiddenInGame(true);
+	SetActorTickEnabled(false);
+	PendingShotEvents.Reset();
+
+	// stop replicating until it's equipped again, clients keep their copy of the actor
+	SetNetDormancy(DORM_DormantAll);
+}
+
+void AWeapon::Unstash()
+{
+	SetNetDormancy(DORM_Awake);
+	SetActorHiddenInGame(false);
+	SetActorTickEnabled(true);
+}
+
 bool AWeapon::IsEquipped() const
 {
 	return bIsEquipped;
@@ -252,6 +495,9 @@ void AWeapon::StartFire()
 	// if (Role < ROLE_Authority)
 	if (!HasAuthority())
 	{
+		// the server never stopped, so the pending stop is dropped
+		bPendingServerStopFire = false;
+
 		// ask the server to start firing
 		ServerStartFire();
 	}
@@ -272,8 +518,19 @@ void AWeapon::StopFire()
 	//if ((Role < ROLE_Authority) && PawnOwner && PawnOwner->IsLocallyControlled())
 	if ((!HasAuthority()) && PawnOwner && PawnOwner->IsLocallyControlled())
 	{
-		// ask the server to stop firing
-		ServerStopFire();
+		// queued shots need to reach the server before it stops firing
+		FlushPendingShots();
+
+		// shots still being traced are sent next frame, so the stop waits for them
+		if (PendingTraces.Num() > 0 || InFlightTraces.Num() > 0)
+		{
+			bPendingServerStopFire = true;
+		}
+		else
+		{
+			// ask the server to stop firing
+			ServerStopFire();
+		}
 	}
 
 	// if wants to fire is true
@@ -402,12 +659,8 @@ int32 AWeapon::GetCurrentAmmo() const
 		// player has a valid inventory
 		if (UInventoryComponent* Inventory = PawnOwner->PlayerInventory)
 		{
-			// look in the inventory for the ammo type desired
-			if (UBaseItem* Ammo = Inventory->FindItemByClass(WeaponConfig.AmmoClass))
-			{
-				// return how much ammo is available
-				return Ammo->GetQuantity();
-			}
+			// how much of the ammo type is available, a map lookup as this runs every time the weapon state is checked
+			return Inventory->GetItemQuantity(WeaponConfig.AmmoClass);
 		}
 	}
 
@@ -513,12 +766,6 @@ bool AWeapon::ServerStopReload_Validate()
 	return true;
 }
 
-// in final code, not video
-// void AWeapon::OnRep_HitNotify()
-// {
-// 	SimulateInstantHit(HitNotify);
-// }
-
 void AWeapon::OnRep_PawnOwner()
 {
 
@@ -578,7 +825,17 @@ void AWeapon::SimulateWeaponFire()
 			}
 			else
 			{
-				MuzzlePSC = UGameplayStatics::SpawnEmitterAttached(MuzzleParticles, WeaponMesh, MuzzleAttachPoint);
+				// one shot muzzle flashes for other players come from the pool
+				// looped ones are held in MuzzlePSC and the local players relies on owner only visibility, so those aren't pooled
+				UWeaponFXPool* FXPool = bLoopedMuzzleFX ? nullptr : GetWorld()->GetSubsystem<UWeaponFXPool>();
+				if (FXPool)
+				{
+					FXPool->SpawnEmitterAttached(MuzzleParticles, WeaponMesh, MuzzleAttachPoint);
+				}
+				else
+				{
+					MuzzlePSC = UGameplayStatics::SpawnEmitterAttached(MuzzleParticles, WeaponMesh, MuzzleAttachPoint);
+				}
 			}
 		}
 	}
@@ -598,7 +855,7 @@ void AWeapon::SimulateWeaponFire()
 	{
 		if (FireAC == NULL)
 		{
-			FireAC = PlayWeaponSound(FireLoopSound);
+			FireAC = PlayWeaponSound(FireLoopSound, true);
 		}
 	}
 	else
@@ -663,7 +920,118 @@ void AWeapon::StopSimulatingWeaponFire()
 	}
 }
 
-void AWeapon::HandleHit(const FHitResult& Hit, class AMainCharacter* HitPlayer /*= nullptr*/)
+void AWeapon::ServerAddShotEvent(const FVector& Origin, const FVector& Direction, const FVector* ImpactPoint, const uint8 SurfaceType)
+{
+	// nobody else to send to
+	if (GetNetMode() == NM_Standalone)
+	{
+		return;
+	}
+
+	// anything over the cap is dropped until the next send, the shots still show their muzzle flash from BurstCounter
+	if (PendingShotEvents.Num() >= MaxShotEventsPerUpdate)
+	{
+		INC_DWORD_STAT(STAT_WeaponShotEventsDropped);
+		return;
+	}
+
+	FShotEvent& Event = PendingShotEvents.AddDefaulted_GetRef();
+	if (ImpactPoint)
+	{
+		// the impact point comes from the client, keep it on the shot so it can't put effects anywhere it likes
+		const float ImpactDistance = FMath::Clamp(FVector::DotProduct(*ImpactPoint - Origin, Direction), 0.f, HitScanConfig.Distance);
+		Event.ImpactPoint = Origin + Direction * ImpactDistance;
+		Event.SurfaceType = SurfaceType;
+		Event.bHit = true;
+	}
+	else
+	{
+		Event.ImpactPoint = Origin + Direction * HitScanConfig.Distance;
+	}
+}
+
+void AWeapon::SimulateShotEvents(const TArray<FShotEvent>& Events)
+{
+	APlayerController* PC = GetWorld()->GetFirstPlayerController();
+	if (!PC)
+	{
+		return;
+	}
+
+	FVector ViewLocation;
+	FRotator ViewRotation;
+	PC->GetPlayerViewPoint(ViewLocation, ViewRotation);
+
+	const FVector MuzzleLocation = GetActorLocation();
+	const float CullDistanceSq = FMath::Square(ShotEventCullDistance);
+
+	// the cap on the server also caps how many effects a client spawns per update
+	for (const FShotEvent& Event : Events)
+	{
+		// only the shots that pass close enough to the viewer to be seen
+		if (FMath::PointDistToSegmentSquared(ViewLocation, MuzzleLocation, Event.ImpactPoint) <= CullDistanceSq)
+		{
+			SimulateInstantHit(Event);
+		}
+	}
+}
+
+void AWeapon::OnRep_ShotEventBatch()
+{
+	// a batch from before the weapon became relevant, or one that took too long to arrive, isn't a shot that just happened
+	if (GetServerWorldTime() - ShotEventBatch.ServerTime > MaxShotEventAge)
+	{
+		return;
+	}
+
+	SimulateShotEvents(ShotEventBatch.Events);
+}
+
+void AWeapon::SimulateInstantHit(const FShotEvent& Event)
+{
+	UWeaponFXPool* FXPool = GetWorld()->GetSubsystem<UWeaponFXPool>();
+	if (!FXPool)
+	{
+		return;
+	}
+
+	// tracer from the muzzle to the impact
+	if (TracerParticles)
+	{
+		const FVector Origin = WeaponMesh->DoesSocketExist(MuzzleAttachPoint) ? WeaponMesh->GetSocketLocation(MuzzleAttachPoint) : GetActorLocation();
+		if (UParticleSystemComponent* TracerPSC = FXPool->SpawnEmitterAtLocation(TracerParticles, Origin, (Event.ImpactPoint - Origin).Rotation()))
+		{
+			TracerPSC->SetVectorParameter(TracerTargetParam, Event.ImpactPoint);
+		}
+	}
+
+	if (Event.bHit)
+	{
+		SpawnImpactEffects(Event);
+	}
+}
+
+void AWeapon::SpawnImpactEffects(const FShotEvent& Event)
+{
+	// surface specific effect if there is one
+	UParticleSystem* const* SurfaceParticles = SurfaceImpactParticles.Find(TEnumAsByte<EPhysicalSurface>((EPhysicalSurface)Event.SurfaceType));
+	UParticleSystem* Particles = SurfaceParticles ? *SurfaceParticles : ImpactParticles;
+	if (!Particles)
+	{
+		return;
+	}
+
+	// the normal isn't sent, face the effect back along the shot
+	const FVector Origin = GetActorLocation();
+	const FRotator ImpactRotation = (Origin - Event.ImpactPoint).Rotation();
+
+	if (UWeaponFXPool* FXPool = GetWorld()->GetSubsystem<UWeaponFXPool>())
+	{
+		FXPool->SpawnEmitterAtLocation(Particles, Event.ImpactPoint, ImpactRotation);
+	}
+}
+
+void AWeapon::HandleHit(const FHitResult& Hit, class AMainCharacter* HitPlayer, const float ShotTime)
 {
 	// check for the hit to be on an actor
 	if (Hit.GetActor())
@@ -672,8 +1040,12 @@ void AWeapon::HandleHit(const FHitResult& Hit, class AMainCharacter* HitPlayer /
 		UE_LOG(LogTemp, Warning, TEXT("Hit actor %s"), *Hit.GetActor()->GetName());
 	}
 
-	// pass to the server
-	ServerHandleHit(Hit, HitPlayer);
+	// pass to the server with the time of the shot so it can rewind the hit player
+	// batched shots already carry the hit, so they dont need their own RPC
+	if (!ShouldBatchShots())
+	{
+		ServerHandleHit(Hit, HitPlayer, ShotTime);
+	}
 
 	// check for valid hit player and shooter
 	if (HitPlayer && PawnOwner)
@@ -687,45 +1059,161 @@ void AWeapon::HandleHit(const FHitResult& Hit, class AMainCharacter* HitPlayer /
 	}
 }
 
-void AWeapon::ServerHandleHit_Implementation(const FHitResult& Hit, class AMainCharacter* HitPlayer /*= nullptr*/)
+void AWeapon::ServerHandleHit_Implementation(const FHitResult& Hit, class AMainCharacter* HitPlayer /*= nullptr*/, float ShotTime /*= 0.f*/)
 {
+	SCOPE_CYCLE_COUNTER(STAT_WeaponServerHandleHit);
+	CSV_SCOPED_TIMING_STAT(TrolledWeapon, ServerHandleHit);
+
+	// clients that batch their shots send hits with ServerHandleShots, a hit here would skip the checks the batched shots go through
+	if (ServerExpectsBatchedShots())
+	{
+		return;
+	}
+
+#if !UE_BUILD_SHIPPING
+	// measure the payload so it can be compared against the batched path
+	if (UNetConnection* Connection = GetNetConnection())
+	{
+		FNetBitWriter Writer(Connection->PackageMap, 256);
+		FHitResult HitCopy = Hit;
+		bool bSuccess = true;
+		HitCopy.NetSerialize(Writer, Connection->PackageMap, bSuccess);
+		UObject* HitObject = HitPlayer;
+		Connection->PackageMap->SerializeObject(Writer, AMainCharacter::StaticClass(), HitObject);
+		Writer << ShotTime;
+		TrackWeaponRPC(false, Writer.GetNumBits(), 1);
+	}
+#endif
+
 	if (PawnOwner)
 	{
-		// set damage multiplier
-		float DamageMultiplier = 1.f;
+		// the hit has to belong to a shot the server fired with ammo, and each pellet of that shot can only hit once
+		// the listen server host fires locally, so there are only records for remote clients
+		if (!PawnOwner->IsLocallyControlled() && !ServerClaimPerShotHit(ShotTime))
+		{
+			TrackRejection(true, TEXT("hit without a shot left to hit with"));
+			return;
+		}
 
-		// Certain bones like head might give extra damage if hit. Apply those.
-		for (auto& BoneDamageModifier : HitScanConfig.BoneDamageModifiers)
+		// dont trust the client, check the hit player was actually where the client says they were
+		// the per shot RPC doesn't say when a simulated bullet was fired, so allow for it flying its whole lifetime
+		const float FlightTime = WeaponConfig.Ballistics == EWeaponBallistics::Simulated ? WeaponConfig.BulletLifetime : 0.f;
+		if (HitPlayer && !ServerValidateHit(HitPlayer, ShotTime, Hit.TraceStart, (Hit.TraceEnd - Hit.TraceStart).GetSafeNormal(), Hit.BoneName, FlightTime))
 		{
-			if (Hit.BoneName == BoneDamageModifier.Key)
-			{
-				DamageMultiplier = BoneDamageModifier.Value;
-				break;
-			}
+			TrackRejection(true, TEXT("hit failed the rewind check"));
+			return;
 		}
 
+		const FVector Direction = (Hit.TraceEnd - Hit.TraceStart).GetSafeNormal();
+		ServerAddShotEvent(Hit.TraceStart, Direction, &Hit.ImpactPoint, UPhysicalMaterial::DetermineSurfaceType(Hit.PhysMaterial.Get()));
+
+		ServerApplyHitDamage(Hit, HitPlayer);
+	}
+}
+
+void AWeapon::ServerApplyHitDamage(const FHitResult& Hit, class AMainCharacter* HitPlayer, int32 BoneIndex /*= INDEX_NONE*/)
+{
+	if (PawnOwner)
+	{
 		if (HitPlayer)
 		{
+			USkeletalMeshComponent* HitMesh = HitPlayer->GetMesh();
+
+			// hits from ServerHandleHit only have the bone name
+			if (BoneIndex == INDEX_NONE && HitMesh && Hit.BoneName != NAME_None)
+			{
+				BoneIndex = HitMesh->GetBoneIndex(Hit.BoneName);
+			}
+
+			// Certain bones like head might give extra damage if hit, child bones use the modifier of their closest parent.
+			const float DamageMultiplier = GetBoneDamageMultiplier(HitMesh, BoneIndex);
+
 			// apply point damage
 			UGameplayStatics::ApplyPointDamage(HitPlayer, HitScanConfig.Damage * DamageMultiplier, (Hit.TraceStart - Hit.TraceEnd).GetSafeNormal(), Hit, PawnOwner->GetController(), this, HitScanConfig.DamageType);
 		}
 	}
 }
 
+float AWeapon::GetBoneDamageMultiplier(const USkeletalMeshComponent* HitMesh, const int32 BoneIndex) const
+{
+	if (!HitMesh || !HitMesh->SkeletalMesh || BoneIndex == INDEX_NONE || HitScanConfig.BoneDamageModifiers.Num() == 0)
+	{
+		return 1.f;
+	}
+
+	UBoneDamageTables* BoneDamageTables = GetWorld()->GetSubsystem<UBoneDamageTables>();
+	if (!BoneDamageTables)
+	{
+		return 1.f;
+	}
+
+	const TArray<float>& DamageTable = BoneDamageTables->GetTable(GetClass(), HitScanConfig.BoneDamageModifiers, BoneDamageModifiersHash, HitMesh->SkeletalMesh);
+	return DamageTable.IsValidIndex(BoneIndex) ? DamageTable[BoneIndex] : 1.f;
+}
+
 // validate the hit
-bool AWeapon::ServerHandleHit_Validate(const FHitResult& Hit, class AMainCharacter* HitPlayer /*= nullptr*/)
+// only malformed hits disconnect the client, hits that miss after rewinding are just ignored since lag can cause them
+bool AWeapon::ServerHandleHit_Validate(const FHitResult& Hit, class AMainCharacter* HitPlayer /*= nullptr*/, float ShotTime /*= 0.f*/)
 {
-	return true;
+	return !Hit.TraceStart.ContainsNaN() && !Hit.TraceEnd.ContainsNaN() && !FMath::IsNaN(ShotTime);
+}
+
+bool AWeapon::ServerValidateHit(class AMainCharacter* HitPlayer, const float ShotTime, const FVector& Origin, const FVector& Direction, const FName BoneName, const float FlightTime /*= 0.f*/) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_WeaponHitValidation);
+
+	if (!HitPlayer || !PawnOwner)
+	{
+		return false;
+	}
+
+	// shots from the future are not possible, clamp them to now. Shots older than the history use the oldest frame
+	const float RewindTime = FMath::Min(ShotTime, GetWorld()->GetTimeSeconds());
+
+	// the shot has to start from where the shooter was when they fired, a bullet can start its last step anywhere it could have flown to since
+	const float OriginLeeway = HitScanConfig.ClientSideHitLeeway + WeaponConfig.MuzzleVelocity * FlightTime;
+	if (PawnOwner->HitboxHistory && !PawnOwner->HitboxHistory->WasNearLocation(RewindTime - FlightTime, Origin, OriginLeeway))
+	{
+		return false;
+	}
+
+	// without a history there is nothing to rewind, fall back to the current bounds of the hit player
+	if (!HitPlayer->HitboxHistory)
+	{
+		const FBox Bounds = HitPlayer->GetComponentsBoundingBox().ExpandBy(HitScanConfig.ClientSideHitLeeway);
+		const FVector TraceEnd = Origin + Direction * HitScanConfig.Distance;
+		return FMath::LineBoxIntersection(Bounds, Origin, TraceEnd, TraceEnd - Origin);
+	}
+
+	return HitPlayer->HitboxHistory->ValidateHit(RewindTime, Origin, Direction, HitScanConfig.Distance, BoneName, HitScanConfig.ClientSideHitLeeway);
+}
+
+float AWeapon::GetServerWorldTime() const
+{
+	// the game state keeps clients in sync with the servers clock
+	if (const AGameStateBase* GameState = GetWorld()->GetGameState())
+	{
+		return GameState->GetServerWorldTimeSeconds();
+	}
+
+	return GetWorld()->GetTimeSeconds();
 }
 
+float AWeapon::GetShotServerTime() const
+{
+	// caught up shots were due earlier in the frame, offset the server time by how long ago that was
+	return GetServerWorldTime() - (GetWorld()->GetTimeSeconds() - CurrentShotTime);
+}
 
 void AWeapon::FireShot()
 {
 	if (PawnOwner)
 	{
-		if (ATrolledPlayerController* PC = Cast<ATrolledPlayerController>(PawnOwner->GetController()))
+		// bots fire through their AI controller, which aims from the pawns eyes
+		if (AController* Controller = PawnOwner->GetController())
 		{
-			if (RecoilCurve)
+			ATrolledPlayerController* PC = Cast<ATrolledPlayerController>(Controller);
+			if (PC && RecoilCurve)
 			{
 				// apply recoil to the controller
 				const FVector2D RecoilAmount(RecoilCurve->GetVectorValue(FMath::RandRange(0.f, 1.f)).X, RecoilCurve->GetVectorValue(FMath::RandRange(0.f, 1.f)).Y);
@@ -735,57 +1223,221 @@ void AWeapon::FireShot()
 			// get the players aim
 			FVector CamLoc;
 			FRotator CamRot;
-			PC->GetPlayerViewPoint(CamLoc, CamRot);
-
-			FHitResult Hit;
-			FCollisionQueryParams QueryParams;
-			
-			// ignore self from bullets colliding
-			QueryParams.AddIgnoredActor(this);
-			QueryParams.AddIgnoredActor(PawnOwner);
+			Controller->GetPlayerViewPoint(CamLoc, CamRot);
 
 			// commented out until the character has an IsAiming function
 			FVector FireDir = CamRot.Vector();// PawnOwner->IsAiming() ? CamRot.Vector() : FMath::VRandCone(CamRot.Vector(), FMath::DegreesToRadians(PawnOwner->IsAiming() ? 0.f : 5.f));
-			
-			// trace from camera to max fire distance
-			FVector TraceStart = CamLoc;
-			FVector TraceEnd = (FireDir * HitScanConfig.Distance) + CamLoc;
 
-			// if there was a hit
-			if (GetWorld()->LineTraceSingleByChannel(Hit, TraceStart, TraceEnd, COLLISION_WEAPON, QueryParams))
+			// every pellet shares the shot index and time, the traces are sent from Tick with the rest of the frames traces
+			const uint16 ShotIndex = NextShotIndex++;
+			const float ShotTime = GetShotServerTime();
+			const float PelletSpreadRad = FMath::DegreesToRadians(HitScanConfig.PelletSpread);
+
+			// simulated bullets report their own hits when they land, the shot itself is sent straight away as a miss
+			UBallisticsSubsystem* Ballistics = WeaponConfig.Ballistics == EWeaponBallistics::Simulated ? GetWorld()->GetSubsystem<UBallisticsSubsystem>() : nullptr;
+			if (Ballistics)
 			{
-				// store who was hit
-				AMainCharacter* HitChar = Cast<AMainCharacter>(Hit.GetActor());
+				const float GravityZ = GetWorld()->GetGravityZ() * WeaponConfig.BulletGravityScale;
+				for (int32 PelletIndex = 0; PelletIndex < HitScanConfig.PelletCount; ++PelletIndex)
+				{
+					const FVector BulletDir = PelletSpreadRad > 0.f ? FMath::VRandCone(FireDir, PelletSpreadRad) : FireDir;
+					Ballistics->FireBullet(this, CamLoc, BulletDir * WeaponConfig.MuzzleVelocity, WeaponConfig.BulletDrag, GravityZ, WeaponConfig.BulletLifetime, CurrentShotTime, ShotIndex, PelletIndex);
+				}
+
+				if (ShouldBatchShots())
+				{
+					FWeaponTraceRequest Shot;
+					Shot.Origin = CamLoc;
+					Shot.Direction = FireDir;
+					Shot.ShotIndex = ShotIndex;
+					Shot.ShotTime = ShotTime;
+					QueueShot(Shot, nullptr);
+				}
 
-				// hit that play
-				HandleHit(Hit, HitChar);
+				return;
+			}
 
-				// draw a debug point to indicate the shot
-				FColor PointColor = FColor::Red;
-				DrawDebugPoint(GetWorld(), Hit.ImpactPoint, 5.f, PointColor, false, 30.f);
+			for (int32 PelletIndex = 0; PelletIndex < HitScanConfig.PelletCount; ++PelletIndex)
+			{
+				// trace from camera to max fire distance
+				FWeaponTraceRequest& Trace = PendingTraces.AddDefaulted_GetRef();
+				Trace.Origin = CamLoc;
+				Trace.Direction = PelletSpreadRad > 0.f ? FMath::VRandCone(FireDir, PelletSpreadRad) : FireDir;
+				Trace.ShotIndex = ShotIndex;
+				Trace.PelletIndex = PelletIndex;
+				Trace.ShotTime = ShotTime;
 			}
 		}
 	}
 }
 
-// adjusts subsequent shots for automatic weapons, smoothing out the rapid fire
-void AWeapon::HandleReFiring()
+FCollisionQueryParams AWeapon::GetWeaponTraceParams() const
+{
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(WeaponTrace));
+
+	// ignore self from bullets colliding
+	QueryParams.AddIgnoredActor(this);
+	QueryParams.AddIgnoredActor(PawnOwner);
+
+	// the surface picks the impact effect
+	QueryParams.bReturnPhysicalMaterial = true;
+
+	return QueryParams;
+}
+
+void AWeapon::SubmitWeaponTraces()
 {
-	UWorld* MyWorld = GetWorld();
+	SCOPE_CYCLE_COUNTER(STAT_WeaponTraceGameThread);
+	INC_DWORD_STAT_BY(STAT_WeaponTraces, PendingTraces.Num());
+
+	const FCollisionQueryParams QueryParams = GetWeaponTraceParams();
+
+	for (FWeaponTraceRequest& Trace : PendingTraces)
+	{
+		const FVector TraceEnd = Trace.Origin + Trace.Direction * HitScanConfig.Distance;
 
-	float SlackTimeThisFrame = FMath::Max(0.0f, (MyWorld->TimeSeconds - LastFireTime) - WeaponConfig.TimeBetweenShots);
+		if (!bAsyncWeaponTraces)
+		{
+			// blocking trace, resolved straight away
+			const FHitResult Hit = WeaponTrace(Trace.Origin, TraceEnd);
+			ResolveWeaponTrace(Trace, Hit.bBlockingHit ? &Hit : nullptr);
+		}
+		else if (HitScanConfig.Radius > 0.f)
+		{
+			Trace.Handle = GetWorld()->AsyncSweepByChannel(EAsyncTraceType::Single, Trace.Origin, TraceEnd, FQuat::Identity, COLLISION_WEAPON, FCollisionShape::MakeSphere(HitScanConfig.Radius), QueryParams);
+		}
+		else
+		{
+			Trace.Handle = GetWorld()->AsyncLineTraceByChannel(EAsyncTraceType::Single, Trace.Origin, TraceEnd, COLLISION_WEAPON, QueryParams);
+		}
+	}
 
-	if (bAllowAutomaticWeaponCatchup)
+	if (bAsyncWeaponTraces)
 	{
-		TimerIntervalAdjustment -= SlackTimeThisFrame;
+		InFlightTraces.Append(PendingTraces);
 	}
 
-	HandleFiring();
+	PendingTraces.Reset();
+}
+
+void AWeapon::ResolveWeaponTraces()
+{
+	SCOPE_CYCLE_COUNTER(STAT_WeaponTraceGameThread);
+
+	// results come back in the order the traces were sent, so the first pellet of a shot is always queued before the rest
+	for (const FWeaponTraceRequest& Trace : InFlightTraces)
+	{
+		// results are only kept for a frame, if they were missed the shot still has to be sent so treat it as a miss
+		FTraceDatum TraceData;
+		const FHitResult* Hit = nullptr;
+		if (GetWorld()->QueryTraceData(Trace.Handle, TraceData) && TraceData.OutHits.Num() > 0 && TraceData.OutHits[0].bBlockingHit)
+		{
+			Hit = &TraceData.OutHits[0];
+		}
+
+		ResolveWeaponTrace(Trace, Hit);
+	}
+
+	InFlightTraces.Reset();
+}
+
+void AWeapon::OnBulletImpact(const FBulletImpact& Impact)
+{
+	// sent on like a trace hit, timestamped with when the bullet landed
+	FWeaponTraceRequest Trace;
+	Trace.Origin = Impact.SegmentStart;
+	Trace.Direction = Impact.Direction;
+	Trace.ShotIndex = Impact.ShotIndex;
+	Trace.PelletIndex = Impact.PelletIndex;
+	Trace.ShotTime = GetServerWorldTime() - (GetWorld()->GetTimeSeconds() - Impact.ImpactTime);
+	Trace.bImpact = true;
+
+	ResolveWeaponTrace(Trace, &Impact.Hit);
+}
+
+void AWeapon::ResolveWeaponTrace(const FWeaponTraceRequest& Trace, const FHitResult* Hit)
+{
+	// batched shots are sent whether they hit or not, they replace ServerHandleFiring
+	// extra pellets only matter to the server when they hit
+	if (ShouldBatchShots() && (Hit || Trace.PelletIndex == 0))
+	{
+		QueueShot(Trace, Hit);
+	}
+
+	// if there was a hit
+	if (Hit)
+	{
+		// store who was hit
+		AMainCharacter* HitChar = Cast<AMainCharacter>(Hit->GetActor());
+
+		// hit that play
+		HandleHit(*Hit, HitChar, Trace.ShotTime);
+
+		// draw a debug point to indicate the shot
+		FColor PointColor = FColor::Red;
+		DrawDebugPoint(GetWorld(), Hit->ImpactPoint, 5.f, PointColor, false, 30.f);
+	}
+
+	// the firing shot of a simulated weapon has nowhere to draw a tracer to, its bullets show their impacts when they land
+	if (!Hit && WeaponConfig.Ballistics == EWeaponBallistics::Simulated)
+	{
+		return;
+	}
+
+	const uint8 SurfaceType = Hit ? (uint8)UPhysicalMaterial::DetermineSurfaceType(Hit->PhysMaterial.Get()) : (uint8)SurfaceType_Default;
+	const FVector ImpactPoint = Hit ? Hit->ImpactPoint : Trace.Origin + Trace.Direction * HitScanConfig.Distance;
+
+	// the listen server host sends its own misses to the other clients, its hits are added by ServerHandleHit
+	if (HasAuthority() && !Hit)
+	{
+		ServerAddShotEvent(Trace.Origin, Trace.Direction, nullptr, SurfaceType);
+	}
+
+	// the shooter plays its own effects straight away
+	if (GetNetMode() != NM_DedicatedServer)
+	{
+		FShotEvent Event;
+		Event.ImpactPoint = ImpactPoint;
+		Event.SurfaceType = SurfaceType;
+		Event.bHit = Hit != nullptr;
+		SimulateInstantHit(Event);
+	}
+}
+
+// fires the shots for automatic weapons, several per frame if the frame rate is lower than the fire rate
+void AWeapon::ProcessScheduledShots()
+{
+	const float GameTime = GetWorld()->GetTimeSeconds();
+
+	// capped to one batch so a long hitch can't dump a whole mag in one frame
+	int32 NumShots = 0;
+	while (NextShotTime > 0.f && NextShotTime <= GameTime && NumShots < MaxShotsPerBatch)
+	{
+		// without catchup the shot is fired now, which pushes the next shot back by however late this one was
+		CurrentShotTime = bAllowAutomaticWeaponCatchup ? NextShotTime : GameTime;
+		NextShotTime = 0.f;
+		++NumShots;
+
+		// reschedules NextShotTime if the weapon is still firing
+		HandleFiring();
+	}
+
+	// drop whatever is left over from the hitch
+	if (NextShotTime > 0.f && NextShotTime < GameTime)
+	{
+		NextShotTime = GameTime;
+	}
 }
 
 // client side shooting
 void AWeapon::HandleFiring()
 {
+	SCOPE_CYCLE_COUNTER(STAT_WeaponHandleFiring);
+	CSV_SCOPED_TIMING_STAT(TrolledWeapon, HandleFiring);
+
+	// set when this call queued a batched shot, which replaces ServerHandleFiring
+	bool bQueuedShot = false;
+
 	// check for ammo and can fire
 	if ((CurrentAmmoInMag > 0) && CanFire())
 	{
@@ -798,7 +1450,10 @@ void AWeapon::HandleFiring()
 		// if local, fire, use ammo increment burst counter
 		if (PawnOwner && PawnOwner->IsLocallyControlled())
 		{
+			// batched shots are queued when their trace resolves, simulated bullets queue the shot straight away
+			const int32 NumQueued = PendingTraces.Num() + PendingShots.Num();
 			FireShot();
+			bQueuedShot = ShouldBatchShots() && PendingTraces.Num() + PendingShots.Num() > NumQueued;
 			UseMagAmmo();
 
 			// update firing FX on remote clients if function was called on server
@@ -833,7 +1488,7 @@ void AWeapon::HandleFiring()
 		// if local player and not the server
 		// doesnt work, changed to has authority
 		//if (Role < ROLE_Authority)
-		if (!HasAuthority())
+		if (!HasAuthority() && !bQueuedShot)
 		{
 			ServerHandleFiring();
 		}
@@ -844,16 +1499,15 @@ void AWeapon::HandleFiring()
 			StartReload();
 		}
 
-		// setup refire timer
+		// schedule the next shot exactly TimeBetweenShots after this one, the tick fires it
 		bRefiring = (CurrentState == EWeaponState::Firing && WeaponConfig.TimeBetweenShots > 0.0f);
 		if (bRefiring)
 		{
-			GetWorldTimerManager().SetTimer(TimerHandle_HandleFiring, this, &AWeapon::HandleReFiring, FMath::Max<float>(WeaponConfig.TimeBetweenShots + TimerIntervalAdjustment, SMALL_NUMBER), false);
-			TimerIntervalAdjustment = 0.f;
+			NextShotTime = CurrentShotTime + WeaponConfig.TimeBetweenShots;
 		}
 	}
 
-	LastFireTime = GetWorld()->GetTimeSeconds();
+	LastFireTime = CurrentShotTime;
 }
 
 void AWeapon::OnBurstStarted()
@@ -863,10 +1517,11 @@ void AWeapon::OnBurstStarted()
 	if (LastFireTime > 0 && WeaponConfig.TimeBetweenShots > 0.0f &&
 		LastFireTime + WeaponConfig.TimeBetweenShots > GameTime)
 	{
-		GetWorldTimerManager().SetTimer(TimerHandle_HandleFiring, this, &AWeapon::HandleFiring, LastFireTime + WeaponConfig.TimeBetweenShots - GameTime, false);
+		NextShotTime = LastFireTime + WeaponConfig.TimeBetweenShots;
 	}
 	else
 	{
+		CurrentShotTime = GameTime;
 		HandleFiring();
 	}
 }
@@ -882,11 +1537,9 @@ void AWeapon::OnBurstFinished()
 		StopSimulatingWeaponFire();
 	}
 
-	GetWorldTimerManager().ClearTimer(TimerHandle_HandleFiring);
+	// cancel the next scheduled shot
+	NextShotTime = 0.f;
 	bRefiring = false;
-
-	// reset firing interval adjustment
-	TimerIntervalAdjustment = 0.0f;
 }
 
 void AWeapon::SetWeaponState(EWeaponState NewState)
@@ -967,12 +1620,21 @@ void AWeapon::AttachMeshToPawn()
 // }
 
 // play the weapon sound
-UAudioComponent* AWeapon::PlayWeaponSound(USoundCue* Sound)
+UAudioComponent* AWeapon::PlayWeaponSound(USoundCue* Sound, const bool bPersistent /*= false*/)
 {
 	UAudioComponent* AC = NULL;
 	if (Sound && PawnOwner)
 	{
-		AC = UGameplayStatics::SpawnSoundAttached(Sound, PawnOwner->GetRootComponent());
+		// one shot sounds come from the pool, persistent ones are held by the caller
+		UWeaponFXPool* FXPool = bPersistent ? nullptr : GetWorld()->GetSubsystem<UWeaponFXPool>();
+		if (FXPool)
+		{
+			AC = FXPool->SpawnSoundAttached(Sound, PawnOwner->GetRootComponent());
+		}
+		else
+		{
+			AC = UGameplayStatics::SpawnSoundAttached(Sound, PawnOwner->GetRootComponent());
+		}
 	}
 
 	return AC;
@@ -1031,11 +1693,17 @@ void AWeapon::StopWeaponAnimation(const FWeaponAnim& Animation)
 FHitResult AWeapon::WeaponTrace(const FVector& StartTrace, const FVector& EndTrace) const
 {
 	// Perform trace to retrieve hit info
-	FCollisionQueryParams TraceParams(SCENE_QUERY_STAT(WeaponTrace), true, GetInstigator());
-	TraceParams.bReturnPhysicalMaterial = true;
+	const FCollisionQueryParams TraceParams = GetWeaponTraceParams();
 
 	FHitResult Hit(ForceInit);
-	GetWorld()->LineTraceSingleByChannel(Hit, StartTrace, EndTrace, COLLISION_WEAPON, TraceParams);
+	if (HitScanConfig.Radius > 0.f)
+	{
+		GetWorld()->SweepSingleByChannel(Hit, StartTrace, EndTrace, FQuat::Identity, COLLISION_WEAPON, FCollisionShape::MakeSphere(HitScanConfig.Radius), TraceParams);
+	}
+	else
+	{
+		GetWorld()->LineTraceSingleByChannel(Hit, StartTrace, EndTrace, COLLISION_WEAPON, TraceParams);
+	}
 
 	return Hit;
 }
@@ -1043,10 +1711,41 @@ FHitResult AWeapon::WeaponTrace(const FVector& StartTrace, const FVector& EndTra
 // server side for shooting
 void AWeapon::ServerHandleFiring_Implementation()
 {
+#if !UE_BUILD_SHIPPING
+	// no parameters, only the RPC itself is counted
+	TrackWeaponRPC(false, 0, 1);
+#endif
+
+	// clients that batch their shots fire with ServerHandleShots, firing here would skip the checks the batched shots go through
+	if (ServerExpectsBatchedShots())
+	{
+		return;
+	}
+
+	// the per shot RPC has no timestamp, so the shot is timed by when it arrived. Jitter can bunch the RPCs up, so a shot can arrive up to
+	// PerShotArrivalLeeway early and is then counted as fired on schedule, that way bunched shots never add up to a faster fire rate
+	const float ArrivalTime = GetServerWorldTime();
+	const float ShotTime = LastServerShotTime >= 0.f ? FMath::Max(ArrivalTime, LastServerShotTime + WeaponConfig.TimeBetweenShots) : ArrivalTime;
+	if (ShotTime > ArrivalTime + PerShotArrivalLeeway || !ServerCheckFireRate(ShotTime))
+	{
+		TrackRejection(false, TEXT("shot faster than the fire rate"));
+		return;
+	}
+
 	const bool bShouldUpdateAmmo = (CurrentAmmoInMag > 0 && CanFire());
 
+	// the shot is fired when it arrives
+	CurrentShotTime = GetWorld()->GetTimeSeconds();
 	HandleFiring();
 
+	// remember the shot so ServerHandleHit can match its pellets to it. A shot that didn't fire can't hit anything
+	// the per shot RPCs don't send a shot index, hits are matched to the newest shot with a pellet left
+	FServerShotRecord& Record = ServerShotRecords[NextServerShotRecord];
+	NextServerShotRecord = (NextServerShotRecord + 1) % ServerShotRecords.Num();
+	Record.ShotIndex = 0;
+	Record.ShotTime = CurrentShotTime;
+	Record.HitMask = bShouldUpdateAmmo ? 0 : MAX_uint32;
+
 	if (bShouldUpdateAmmo)
 	{
 		// update ammo
@@ -1060,4 +1759,378 @@ void AWeapon::ServerHandleFiring_Implementation()
 bool AWeapon::ServerHandleFiring_Validate()
 {
 	return true;
-}
\ No newline at end of file
+}
+
+bool AWeapon::ShouldBatchShots() const
+{
+	// only remote clients send shots, the server handles its own locally
+	return bBatchShotRPCs && !HasAuthority();
+}
+
+bool AWeapon::ServerExpectsBatchedShots() const
+{
+	// the listen server host calls ServerHandleHit on itself, only remote clients batch
+	return bBatchShotRPCs && !(PawnOwner && PawnOwner->IsLocallyControlled());
+}
+
+void AWeapon::QueueShot(const FWeaponTraceRequest& Trace, const FHitResult* Hit)
+{
+	FWeaponShot& Shot = PendingShots.AddDefaulted_GetRef();
+	Shot.ShotIndex = Trace.ShotIndex;
+	Shot.PelletIndex = Trace.PelletIndex;
+	Shot.bImpact = Trace.bImpact;
+	Shot.Timestamp = Trace.ShotTime;
+	Shot.Origin = Trace.Origin;
+	Shot.Direction = Trace.Direction;
+
+	// the bone is sent as an index into the hit mesh to keep the shot small
+	if (Hit && Hit->GetActor())
+	{
+		Shot.HitActor = Hit->GetActor();
+
+		if (const USkeletalMeshComponent* HitMesh = Cast<USkeletalMeshComponent>(Hit->GetComponent()))
+		{
+			Shot.BoneIndex = HitMesh->GetBoneIndex(Hit->BoneName);
+		}
+
+		Shot.ImpactPoint = Hit->ImpactPoint;
+		Shot.SurfaceType = UPhysicalMaterial::DetermineSurfaceType(Hit->PhysMaterial.Get());
+	}
+}
+
+void AWeapon::FlushPendingShots()
+{
+	LastShotFlushTime = GetWorld()->GetTimeSeconds();
+
+	// split into multiple RPCs if more shots than the max were queued
+	for (int32 Start = 0; Start < PendingShots.Num(); Start += MaxShotsPerBatch)
+	{
+		const int32 Count = FMath::Min(MaxShotsPerBatch, PendingShots.Num() - Start);
+		if (Start == 0 && Count == PendingShots.Num())
+		{
+			ServerHandleShots(PendingShots);
+		}
+		else
+		{
+			ServerHandleShots(TArray<FWeaponShot>(PendingShots.GetData() + Start, Count));
+		}
+	}
+
+	PendingShots.Reset();
+}
+
+void AWeapon::ServerHandleShots_Implementation(const TArray<FWeaponShot>& Shots)
+{
+	SCOPE_CYCLE_COUNTER(STAT_WeaponServerHandleShots);
+	CSV_SCOPED_TIMING_STAT(TrolledWeapon, ServerHandleShots);
+
+#if !UE_BUILD_SHIPPING
+	// measure the payload so it can be compared against the per shot path
+	if (UNetConnection* Connection = GetNetConnection())
+	{
+		FNetBitWriter Writer(Connection->PackageMap, 256);
+		for (const FWeaponShot& Shot : Shots)
+		{
+			FWeaponShot ShotCopy = Shot;
+			bool bSuccess = true;
+			ShotCopy.NetSerialize(Writer, Connection->PackageMap, bSuccess);
+		}
+		TrackWeaponRPC(true, Writer.GetNumBits(), Shots.Num());
+	}
+#endif
+
+	// clients that don't batch their shots use the per shot RPCs, mixing the two would let hits claim shots from the other path
+	if (!bBatchShotRPCs)
+	{
+		return;
+	}
+
+	for (const FWeaponShot& Shot : Shots)
+	{
+		ServerProcessShot(Shot);
+	}
+}
+
+bool AWeapon::ServerHandleShots_Validate(const TArray<FWeaponShot>& Shots)
+{
+	// a client can never send more than a full batch in one RPC
+	if (Shots.Num() > MaxShotsPerBatch)
+	{
+		return false;
+	}
+
+	for (const FWeaponShot& Shot : Shots)
+	{
+		if (Shot.Origin.ContainsNaN() || Shot.Direction.ContainsNaN() || FMath::IsNaN(Shot.Timestamp))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void AWeapon::ServerProcessShot(const FWeaponShot& Shot)
+{
+	float RewindTime = Shot.Timestamp;
+	float FlightTime = 0.f;
+
+	// only the first pellet fires, the rest and bullet impacts just apply their hit
+	if (Shot.PelletIndex == 0 && !Shot.bImpact)
+	{
+		// shots faster than the weapon can fire are dropped, they dont use ammo or do damage
+		if (!ServerCheckFireRate(Shot.Timestamp))
+		{
+			TrackRejection(false, TEXT("shot faster than the fire rate"));
+			return;
+		}
+
+		// same as ServerHandleFiring
+		const bool bShouldUpdateAmmo = (CurrentAmmoInMag > 0 && CanFire());
+
+		// fire at the time the client fired, not when the batch arrived. On the server the timestamp is already world time
+		CurrentShotTime = Shot.Timestamp;
+		HandleFiring();
+
+		// remember the shot so its other pellets and bullets can be matched to it. A shot that didn't fire can't hit anything
+		// for hitscan this shot is the first pellet's hit, simulated bullets all land later
+		const bool bSimulated = WeaponConfig.Ballistics == EWeaponBallistics::Simulated;
+		FServerShotRecord& Record = ServerShotRecords[NextServerShotRecord];
+		NextServerShotRecord = (NextServerShotRecord + 1) % ServerShotRecords.Num();
+		Record.ShotIndex = Shot.ShotIndex;
+		Record.ShotTime = Shot.Timestamp;
+		Record.HitMask = !bShouldUpdateAmmo ? MAX_uint32 : (bSimulated ? 0 : 1);
+
+		if (!bShouldUpdateAmmo)
+		{
+			return;
+		}
+
+		// update ammo
+		UseMagAmmo();
+
+		// update firing FX on remote clients
+		BurstCounter++;
+
+		if (bSimulated)
+		{
+			return;
+		}
+	}
+	else if (!ServerCheckShotHit(Shot, RewindTime, FlightTime))
+	{
+		TrackRejection(false, TEXT("pellet or bullet that doesn't match a fired shot"));
+		return;
+	}
+
+	// only characters take damage from hits, everything else just needs its tracer and impact sent to the other clients
+	AMainCharacter* HitPlayer = Cast<AMainCharacter>(Shot.HitActor);
+	if (!HitPlayer || !PawnOwner)
+	{
+		ServerAddShotEvent(Shot.Origin, Shot.Direction, Shot.HitActor ? &Shot.ImpactPoint : nullptr, Shot.SurfaceType);
+		return;
+	}
+
+	// resolve the bone the client sent
+	const FName BoneName = (HitPlayer->GetMesh() && Shot.BoneIndex != INDEX_NONE) ? HitPlayer->GetMesh()->GetBoneName(Shot.BoneIndex) : NAME_None;
+
+	// pellets rewind to the time of the shot they belong to, bullets to when they landed
+	if (!ServerValidateHit(HitPlayer, RewindTime, Shot.Origin, Shot.Direction, BoneName, FlightTime))
+	{
+		TrackRejection(true, TEXT("hit failed the rewind check"));
+
+		// the shot was still fired, so the other clients see its tracer but no impact. Bullets don't have a tracer to show
+		if (WeaponConfig.Ballistics != EWeaponBallistics::Simulated)
+		{
+			ServerAddShotEvent(Shot.Origin, Shot.Direction, nullptr, Shot.SurfaceType);
+		}
+		return;
+	}
+
+	// impacts on players are only shown once the hit has been accepted, like ServerHandleHit
+	ServerAddShotEvent(Shot.Origin, Shot.Direction, &Shot.ImpactPoint, Shot.SurfaceType);
+
+	// rebuild the hit result the damage code expects
+	const FVector TraceEnd = Shot.Origin + Shot.Direction * HitScanConfig.Distance;
+	const FVector ImpactPoint = BoneName != NAME_None ? FMath::ClosestPointOnSegment(HitPlayer->GetMesh()->GetBoneLocation(BoneName), Shot.Origin, TraceEnd) : HitPlayer->GetActorLocation();
+
+	FHitResult Hit(HitPlayer, HitPlayer->GetMesh(), ImpactPoint, -Shot.Direction);
+	Hit.TraceStart = Shot.Origin;
+	Hit.TraceEnd = TraceEnd;
+	Hit.BoneName = BoneName;
+
+	ServerApplyHitDamage(Hit, HitPlayer, BoneName != NAME_None ? Shot.BoneIndex : INDEX_NONE);
+}
+
+bool AWeapon::ServerCheckShotHit(const FWeaponShot& Shot, float& OutRewindTime, float& OutFlightTime)
+{
+	if (Shot.PelletIndex >= HitScanConfig.PelletCount)
+	{
+		return false;
+	}
+
+	// newest first, the shot is almost always one of the last few
+	for (int32 i = 1; i <= ServerShotRecords.Num(); ++i)
+	{
+		FServerShotRecord& Record = ServerShotRecords[(NextServerShotRecord - i + ServerShotRecords.Num()) % ServerShotRecords.Num()];
+		if (Record.ShotIndex != Shot.ShotIndex)
+		{
+			continue;
+		}
+
+		// each pellet can only hit once
+		const uint32 PelletBit = 1u << Shot.PelletIndex;
+		if (Record.HitMask & PelletBit)
+		{
+			return false;
+		}
+
+		// bullets have to land after they were fired and before they ran out of time, instant pellets hit at the time of the shot
+		if (Shot.bImpact)
+		{
+			OutFlightTime = Shot.Timestamp - Record.ShotTime;
+			if (WeaponConfig.Ballistics != EWeaponBallistics::Simulated || OutFlightTime < 0.f || OutFlightTime > WeaponConfig.BulletLifetime)
+			{
+				return false;
+			}
+
+			OutRewindTime = Shot.Timestamp;
+		}
+		else
+		{
+			OutFlightTime = 0.f;
+			OutRewindTime = Record.ShotTime;
+		}
+
+		Record.HitMask |= PelletBit;
+		return true;
+	}
+
+	return false;
+}
+
+bool AWeapon::ServerClaimPerShotHit(float& InOutShotTime)
+{
+	const float Now = GetWorld()->GetTimeSeconds();
+
+	// hits can arrive a while after the shot for bullets, hitscan hits follow the shot straight away
+	const float MaxFlightTime = WeaponConfig.Ballistics == EWeaponBallistics::Simulated ? WeaponConfig.BulletLifetime : 0.f;
+	const uint32 PelletMask = HitScanConfig.PelletCount >= 32 ? MAX_uint32 : (1u << FMath::Max(HitScanConfig.PelletCount, 1)) - 1;
+
+	// newest first, the hit almost always belongs to the last shot
+	for (int32 i = 1; i <= ServerShotRecords.Num(); ++i)
+	{
+		FServerShotRecord& Record = ServerShotRecords[(NextServerShotRecord - i + ServerShotRecords.Num()) % ServerShotRecords.Num()];
+
+		// records are in the order they were fired, everything past this one is too old to still be hitting
+		if (Now - Record.ShotTime > MaxShotAge + MaxFlightTime)
+		{
+			return false;
+		}
+
+		const uint32 FreePellets = ~Record.HitMask & PelletMask;
+		if (FreePellets == 0)
+		{
+			continue;
+		}
+
+		// use up the lowest pellet left
+		Record.HitMask |= FreePellets & (~FreePellets + 1);
+
+		// the client can't have fired after the server got the shot, or long before it
+		InOutShotTime = FMath::Clamp(InOutShotTime, Record.ShotTime - MaxShotAge, Record.ShotTime);
+		return true;
+	}
+
+	return false;
+}
+
+bool AWeapon::ServerCheckFireRate(const float ShotTime)
+{
+	const float ServerTime = GetServerWorldTime();
+
+	// shots can't be from the future, allow up to one shot ahead for the clients estimate of the server time being off
+	// and can't be too old, otherwise a client could backdate a burst to fill the time since it last fired
+	if (ShotTime > ServerTime + WeaponConfig.TimeBetweenShots || ShotTime < ServerTime - MaxShotAge)
+	{
+		return false;
+	}
+
+	// timestamps have to be at least TimeBetweenShots apart, this also keeps them in order
+	if (LastServerShotTime >= 0.f && ShotTime < LastServerShotTime + WeaponConfig.TimeBetweenShots * (1.f - FireRateTolerance))
+	{
+		return false;
+	}
+
+	LastServerShotTime = ShotTime;
+	return true;
+}
+
+void AWeapon::TrackRejection(const bool bHit, const TCHAR* Reason) const
+{
+	if (bHit)
+	{
+		INC_DWORD_STAT(STAT_WeaponRejectedHits);
+	}
+	else
+	{
+		INC_DWORD_STAT(STAT_WeaponRejectedShots);
+	}
+
+	ATrolledPlayerController* PC = PawnOwner ? Cast<ATrolledPlayerController>(PawnOwner->GetController()) : nullptr;
+	if (!PC)
+	{
+		return;
+	}
+
+	FWeaponNetStats& Stats = PC->WeaponNetStats;
+	if (bHit)
+	{
+		Stats.RejectedHits++;
+	}
+	else
+	{
+		Stats.RejectedShots++;
+	}
+
+	// a client at a high fire rate can be rejected many times a second, only warn once per interval with how many were dropped since
+	++Stats.RejectionsSinceLog;
+	const float Now = GetWorld()->GetTimeSeconds();
+	if (Stats.LastRejectionLogTime < 0.f || Now - Stats.LastRejectionLogTime >= RejectionLogInterval)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Rejected %d shots or hits from %s since the last warning, last reason: %s"), Stats.RejectionsSinceLog, *PawnOwner->GetName(), Reason);
+		Stats.RejectionsSinceLog = 0;
+		Stats.LastRejectionLogTime = Now;
+	}
+	else
+	{
+		UE_LOG(LogTemp, Verbose, TEXT("Rejected %s from %s"), Reason, *PawnOwner->GetName());
+	}
+}
+
+void AWeapon::TrackWeaponRPC(const bool bBatched, const int64 PayloadBits, const int32 NumShots) const
+{
+	// totals across every connection for the frame, RPCs per second in the load test csv
+	CSV_CUSTOM_STAT(TrolledWeapon, WeaponRPCs, 1, ECsvCustomStatOp::Accumulate);
+	CSV_CUSTOM_STAT(TrolledWeapon, WeaponRPCBytes, (int32)((PayloadBits + 7) >> 3), ECsvCustomStatOp::Accumulate);
+
+	if (PawnOwner)
+	{
+		if (ATrolledPlayerController* PC = Cast<ATrolledPlayerController>(PawnOwner->GetController()))
+		{
+			const int64 PayloadBytes = (PayloadBits + 7) >> 3;
+
+			if (bBatched)
+			{
+				PC->WeaponNetStats.BatchedRPCs++;
+				PC->WeaponNetStats.BatchedBytes += PayloadBytes;
+				PC->WeaponNetStats.BatchedShots += NumShots;
+			}
+			else
+			{
+				PC->WeaponNetStats.PerShotRPCs++;
+				PC->WeaponNetStats.PerShotBytes += PayloadBytes;
+			}
+		}
+	}
+}
@@ -4,6 +4,7 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
+#include "WorldCollision.h"
 #include "Weapon.generated.h"
 
 // declare the classes the weapon will use
@@ -25,6 +26,16 @@ enum class EWeaponState : uint8
 	Equipping
 };
 
+// how a weapons shots travel
+UENUM(BlueprintType)
+enum class EWeaponBallistics : uint8
+{
+	// instant trace out to HitScanConfig.Distance
+	HitScan,
+	// bullets with travel time and drop, simulated by UBallisticsSubsystem
+	Simulated
+};
+
 // weapon data, mag size, fire rate
 USTRUCT(BlueprintType)
 struct FWeaponData
@@ -43,11 +54,36 @@ struct FWeaponData
 	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = WeaponStat)
 	float TimeBetweenShots;
 
+	// whether shots are instant traces or simulated bullets
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = Ballistics)
+	EWeaponBallistics Ballistics;
+
+	// speed of simulated bullets leaving the muzzle in cm/s
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = Ballistics, meta = (ClampMin = 1.0, EditCondition = "Ballistics == EWeaponBallistics::Simulated"))
+	float MuzzleVelocity;
+
+	// fraction of its velocity a simulated bullet loses per second
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = Ballistics, meta = (ClampMin = 0.0, EditCondition = "Ballistics == EWeaponBallistics::Simulated"))
+	float BulletDrag;
+
+	// multiplier on world gravity for simulated bullets
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = Ballistics, meta = (ClampMin = 0.0, EditCondition = "Ballistics == EWeaponBallistics::Simulated"))
+	float BulletGravityScale;
+
+	// seconds a simulated bullet flies before it is removed
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = Ballistics, meta = (ClampMin = 0.1, EditCondition = "Ballistics == EWeaponBallistics::Simulated"))
+	float BulletLifetime;
+
 	// weapon defaults
 	FWeaponData()
 	{
 		AmmoPerMag = 30;
 		TimeBetweenShots = 0.2f;
+		Ballistics = EWeaponBallistics::HitScan;
+		MuzzleVelocity = 80000.f;
+		BulletDrag = 0.1f;
+		BulletGravityScale = 1.f;
+		BulletLifetime = 2.f;
 	}
 };
 
@@ -80,6 +116,8 @@ struct FHitScanConfiguration
 		Radius = 0.f;
 		DamageType = UDamageType::StaticClass();
 		ClientSideHitLeeway = 300.f;
+		PelletCount = 1;
+		PelletSpread = 0.f;
 	}
 
 	// A map of bone -> damage amount. If the bone is a child of the given bone, it will use this damage amount.
@@ -99,7 +137,15 @@ struct FHitScanConfiguration
 	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Trace Info")
 	float Radius;
 
-	// client side hit leeway for BoundingBox check
+	// how many traces each shot fires, more than 1 for shotguns. All pellets are traced in the same batch
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Trace Info", meta = (ClampMin = 1, ClampMax = 32))
+	int32 PelletCount;
+
+	// half angle in degrees of the cone the pellets are spread across
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Trace Info", meta = (ClampMin = 0.0, ClampMax = 90.0))
+	float PelletSpread;
+
+	// client side hit leeway for BoundingBox check, used when the server rewinds the hit player to the time of the shot
 	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Trace Info")
 	float ClientSideHitLeeway;
 
@@ -109,6 +155,186 @@ struct FHitScanConfiguration
 
 };
 
+// a single shot sent from the client to the server. Quantized so automatic weapons can send many shots in one RPC
+USTRUCT()
+struct FWeaponShot
+{
+	GENERATED_BODY()
+
+	FWeaponShot()
+	{
+		ShotIndex = 0;
+		Timestamp = 0.f;
+		HitActor = nullptr;
+		BoneIndex = INDEX_NONE;
+		PelletIndex = 0;
+		bImpact = false;
+		ImpactPoint = FVector::ZeroVector;
+		SurfaceType = SurfaceType_Default;
+	}
+
+	// increments every shot and wraps, lets the server spot missing or repeated shots
+	UPROPERTY()
+	uint16 ShotIndex;
+
+	// server world time the shot was fired at
+	UPROPERTY()
+	float Timestamp;
+
+	// where the shot was traced from
+	UPROPERTY()
+	FVector_NetQuantize Origin;
+
+	// direction the shot was traced in
+	UPROPERTY()
+	FVector_NetQuantizeNormal Direction;
+
+	// actor that was hit, null for a miss
+	UPROPERTY()
+	AActor* HitActor;
+
+	// bone on the hit actors mesh, INDEX_NONE if no bone was hit
+	UPROPERTY()
+	int32 BoneIndex;
+
+	// pellet of the shot, only the first pellet fires and uses ammo. Later pellets are only sent when they hit
+	UPROPERTY()
+	uint8 PelletIndex;
+
+	// the hit of a simulated bullet, sent when the bullet lands. Timestamp is the time of the impact and the origin is the start of the bullets last step
+	UPROPERTY()
+	bool bImpact;
+
+	// where the shot hit and the surface it hit, only sent with a hit. Used for the impact effects on other clients
+	UPROPERTY()
+	FVector_NetQuantize ImpactPoint;
+
+	UPROPERTY()
+	uint8 SurfaceType;
+
+	// custom serialization, only sends the hit actor and bone when something was hit
+	bool NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess);
+};
+
+// a weapon trace from FireShot, traced with the rest of the frames traces and resolved the next frame
+struct FWeaponTraceRequest
+{
+	FWeaponTraceRequest()
+	{
+		ShotIndex = 0;
+		PelletIndex = 0;
+		ShotTime = 0.f;
+		bImpact = false;
+	}
+
+	// handle of the async trace, used to get the result
+	FTraceHandle Handle;
+
+	// where the trace starts and its normalized direction
+	FVector Origin;
+	FVector Direction;
+
+	// shot the trace belongs to and which of its pellets it is
+	uint16 ShotIndex;
+	uint8 PelletIndex;
+
+	// server world time the shot was fired at
+	float ShotTime;
+
+	// set for simulated bullet impacts, ShotTime is then the time of the impact
+	bool bImpact;
+};
+
+// a shot accepted by the server, kept so later pellets and bullet impacts can be matched to it
+struct FServerShotRecord
+{
+	FServerShotRecord()
+	{
+		ShotIndex = 0;
+		ShotTime = 0.f;
+		HitMask = MAX_uint32;
+	}
+
+	uint16 ShotIndex;
+
+	// server world time the shot was fired at
+	float ShotTime;
+
+	// a bit for each pellet that has already hit
+	uint32 HitMask;
+};
+
+template<>
+struct TStructOpsTypeTraits<FWeaponShot> : public TStructOpsTypeTraitsBase2<FWeaponShot>
+{
+	enum
+	{
+		WithNetSerializer = true
+	};
+};
+
+// cosmetic result of a shot sent to other clients, enough to play a tracer and an impact without the full hit result
+USTRUCT()
+struct FShotEvent
+{
+	GENERATED_BODY()
+
+	FShotEvent()
+	{
+		ImpactPoint = FVector::ZeroVector;
+		SurfaceType = SurfaceType_Default;
+		bHit = false;
+	}
+
+	// where the shot hit, or the end of the trace for a miss. The tracer starts at the weapons muzzle so the origin isn't sent
+	UPROPERTY()
+	FVector_NetQuantize ImpactPoint;
+
+	// physical surface that was hit, picks the impact effect
+	UPROPERTY()
+	uint8 SurfaceType;
+
+	// misses only play the tracer
+	UPROPERTY()
+	bool bHit;
+
+	// custom serialization, the point is rounded to whole units and the surface is only sent for hits
+	bool NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess);
+};
+
+template<>
+struct TStructOpsTypeTraits<FShotEvent> : public TStructOpsTypeTraitsBase2<FShotEvent>
+{
+	enum
+	{
+		WithNetSerializer = true
+	};
+};
+
+// the shot events of one net update, replicated with the weapon so the net drivers relevancy decides who gets them
+USTRUCT()
+struct FShotEventBatch
+{
+	GENERATED_BODY()
+
+	FShotEventBatch()
+	{
+		BatchId = 0;
+		ServerTime = 0.f;
+	}
+
+	// changes every batch so the same events twice still replicate
+	UPROPERTY()
+	uint8 BatchId;
+
+	// server world time the batch was made, a client the weapon just became relevant to ignores an old batch
+	UPROPERTY()
+	float ServerTime;
+
+	UPROPERTY()
+	TArray<FShotEvent> Events;
+};
+
 UCLASS()
 class TROLLED_API AWeapon : public AActor
 {
@@ -116,6 +342,8 @@ class TROLLED_API AWeapon : public AActor
 
 	// allows AMainCharacter to access any function inside weapon even if its private
 	friend class AMainCharacter;
+	friend class UBallisticsSubsystem;
+	friend class UWeaponLoadTestSubsystem;
 	
 public:	
 	// Sets default values for this actor's properties
@@ -123,10 +351,22 @@ public:
 
 	// replicates weapon variables
 	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
+	// [server] moves this net updates shot events into ShotEventBatch, once per update however many clients it goes to
+	virtual void PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker) override;
+
 	virtual void PostInitializeComponents()override;
 	virtual void BeginPlay() override;
+
+#if WITH_EDITOR
+	// rehashes the bone damage modifiers when they are edited on a placed weapon
+	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
+#endif
 	virtual void Destroyed() override;
 
+	// sends any shots queued this frame to the server
+	virtual void Tick(float DeltaTime) override;
+
 protected:
 	// consume a bullet
 	void UseMagAmmo();
@@ -146,6 +386,12 @@ protected:
 	// weapon is holstered by owner pawn 
 	virtual void OnUnEquip();
 
+	// [server] hides the weapon and makes it dormant so the owner can reuse it the next time this class is equipped
+	void Stash();
+
+	// [server] wakes a stashed weapon back up before it is equipped again
+	void Unstash();
+
 	// check if it's currently equipped 
 	bool IsEquipped() const;
 
@@ -224,7 +470,7 @@ protected:
 	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = Config)
 	FWeaponData WeaponConfig;
 
-	//Line trace data. Will be used if projectile class is null
+	//Line trace data. Traced straight away for WeaponConfig.Ballistics HitScan, simulated bullets still use its damage, bone modifiers and pellets
 	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = Config)
 	FHitScanConfiguration HitScanConfig;
 
@@ -236,14 +482,91 @@ public:
 
 protected:
 
-	// Adjustment to handle frame rate affecting actual timer interval. 
-	UPROPERTY(Transient)
-	float TimerIntervalAdjustment;
-
-	// Whether to allow automatic weapons to catch up with shorter refire cycles 
+	// Whether automatic weapons fire every shot that came due since the last frame, instead of at most one shot per frame
 	UPROPERTY(Config)
 	bool bAllowAutomaticWeaponCatchup = true;
 
+	// how much faster than TimeBetweenShots the server accepts shots, covers drift in the clients estimate of the server time
+	UPROPERTY(EditDefaultsOnly, Category = Config, meta = (ClampMin = 0.0, ClampMax = 1.0))
+	float FireRateTolerance;
+
+	// how far in seconds a client shot can be in the past before the server rejects it, limits how far a burst can be backdated
+	UPROPERTY(EditDefaultsOnly, Category = Config, meta = (ClampMin = 0.0))
+	float MaxShotAge;
+
+	// how early in seconds a ServerHandleFiring can arrive compared to when the fire rate allows the next shot, covers network jitter bunching up the per shot RPCs
+	UPROPERTY(EditDefaultsOnly, Category = Config, meta = (ClampMin = 0.0))
+	float PerShotArrivalLeeway;
+
+	// Whether clients queue their shots and send them once per frame, instead of a fire and a hit RPC per shot
+	UPROPERTY(Config)
+	bool bBatchShotRPCs = true;
+
+	// min seconds between rejected shot warnings for one connection, the rest are counted and logged at Verbose
+	UPROPERTY(Config)
+	float RejectionLogInterval = 5.f;
+
+	// Whether weapon traces are sent through the async scene query API and resolved the next frame, instead of a blocking trace per pellet
+	UPROPERTY(Config)
+	bool bAsyncWeaponTraces = true;
+
+	// [local] traces fired this frame, submitted together from Tick
+	TArray<FWeaponTraceRequest> PendingTraces;
+
+	// [local] traces submitted last frame that are waiting on their results
+	TArray<FWeaponTraceRequest> InFlightTraces;
+
+	// [local] StopFire was called with traces in flight, ServerStopFire is sent once their shots have been flushed
+	bool bPendingServerStopFire;
+
+	// [server] ring of the most recent accepted shots, bullets can land a few shots after they were fired
+	TArray<FServerShotRecord> ServerShotRecords;
+	int32 NextServerShotRecord;
+
+	// max shots sent in one RPC, anything over this is sent in another RPC
+	UPROPERTY(EditDefaultsOnly, Category = Config, meta = (ClampMin = 1))
+	int32 MaxShotsPerBatch;
+
+	// [local] shots fired since the last flush
+	TArray<FWeaponShot> PendingShots;
+
+	// [local] world time the queued shots were last sent, shots go out once per net update of the owner
+	float LastShotFlushTime;
+
+	// [local] index given to the next queued shot
+	uint16 NextShotIndex;
+
+	// [local + server] world time the next automatic shot is due, 0 when no shot is scheduled
+	float NextShotTime;
+
+	// [local + server] world time of the shot being fired, earlier than the frame time when shots are caught up
+	float CurrentShotTime;
+
+	// [server] timestamp of the last accepted shot from the client
+	float LastServerShotTime;
+
+	// how far from a shots path a client can be and still play its tracer and impact
+	UPROPERTY(EditDefaultsOnly, Category = Config, meta = (ClampMin = 0.0))
+	float ShotEventCullDistance;
+
+	// max shot events sent per net update, shots past this only show their muzzle flash
+	UPROPERTY(EditDefaultsOnly, Category = Config, meta = (ClampMin = 1))
+	int32 MaxShotEventsPerUpdate;
+
+	// how old in seconds a batch of shot events can be when it arrives and still be played
+	UPROPERTY(EditDefaultsOnly, Category = Config, meta = (ClampMin = 0.0))
+	float MaxShotEventAge;
+
+	// [server] shot events since the last net update, moved into ShotEventBatch when the weapon replicates
+	TArray<FShotEvent> PendingShotEvents;
+
+	// shot events of the last net update, tracers and impacts for everyone but the shooter
+	UPROPERTY(Transient, ReplicatedUsing = OnRep_ShotEventBatch)
+	FShotEventBatch ShotEventBatch;
+
+	// [server] hash of HitScanConfig.BoneDamageModifiers, picks the shared bone damage table so overrides on the instance are used
+	uint32 BoneDamageModifiersHash;
+
 	// firing audio (bLoopedFireSound set) 
 	UPROPERTY(Transient)
 	UAudioComponent* FireAC;
@@ -272,6 +595,18 @@ protected:
 	UPROPERTY(EditDefaultsOnly, Category = Effects)
 	UParticleSystem* ImpactParticles;
 
+	// impact FX for specific surfaces, anything not in here uses ImpactParticles
+	UPROPERTY(EditDefaultsOnly, Category = Effects)
+	TMap<TEnumAsByte<EPhysicalSurface>, UParticleSystem*> SurfaceImpactParticles;
+
+	// FX for the bullet tracer, spawned at the muzzle
+	UPROPERTY(EditDefaultsOnly, Category = Effects)
+	UParticleSystem* TracerParticles;
+
+	// vector parameter on the tracer FX that is set to the impact point
+	UPROPERTY(EditDefaultsOnly, Category = Effects)
+	FName TracerTargetParam;
+
 	// spawned component for muzzle FX 
 	UPROPERTY(Transient)
 	UParticleSystemComponent* MuzzlePSC;
@@ -388,13 +723,6 @@ protected:
 	// how much time weapon needs to be equipped 
 	float EquipDuration;
 
-	// in code, not video
-	// UPROPERTY(Transient, ReplicatedUsing = OnRep_HitNotify)
-	// FVector HitNotify;
-
-	// UFUNCTION()
-	// void OnRep_HitNotify();
-
 	// current ammo - inside mag 
 	UPROPERTY(Transient, Replicated)
 	int32 CurrentAmmoInMag;
@@ -412,9 +740,6 @@ protected:
 	// Handle for efficient management of ReloadWeapon timer 
 	FTimerHandle TimerHandle_ReloadWeapon;
 
-	// Handle for efficient management of HandleFiring timer 
-	FTimerHandle TimerHandle_HandleFiring;
-
 //////////////////////////////////////////////////////////////////////////
 // Input - server side
 
@@ -445,6 +770,10 @@ protected:
 	UFUNCTION()
 	void OnRep_Reload();
 
+	// rep tracers and impacts
+	UFUNCTION()
+	void OnRep_ShotEventBatch();
+
 	// Called in network play to do the cosmetic fx for firing 
 	virtual void SimulateWeaponFire();
 
@@ -454,12 +783,65 @@ protected:
 //////////////////////////////////////////////////////////////////////////
 // Weapon usage
 
-	// handle hit locally before being called to the server
-	void HandleHit(const FHitResult& Hit, class AMainCharacter* HitPlayer = nullptr);
+	// handle hit locally before being called to the server, ShotTime is the server world time the shot was fired at
+	void HandleHit(const FHitResult& Hit, class AMainCharacter* HitPlayer, const float ShotTime);
+
+	// [local] sends the frames traces, or traces them straight away without bAsyncWeaponTraces
+	void SubmitWeaponTraces();
+
+	// [local] reads the results of last frames traces
+	void ResolveWeaponTraces();
 
-	// server verification of hit
+	// [local] handles a finished trace, Hit is null for a miss
+	void ResolveWeaponTrace(const FWeaponTraceRequest& Trace, const FHitResult* Hit);
+
+	// query params shared by the sync and async weapon traces
+	FCollisionQueryParams GetWeaponTraceParams() const;
+
+	// server verification of hit, ShotTime is the server world time the client fired at
 	UFUNCTION(Server, Reliable, WithValidation)
-	void ServerHandleHit(const FHitResult& Hit, class AMainCharacter* HitPlayer = nullptr);
+	void ServerHandleHit(const FHitResult& Hit, class AMainCharacter* HitPlayer = nullptr, float ShotTime = 0.f);
+
+	// [server] applies damage for a validated hit, BoneIndex is the index of Hit.BoneName on the hit players mesh if it is already known
+	void ServerApplyHitDamage(const FHitResult& Hit, class AMainCharacter* HitPlayer, int32 BoneIndex = INDEX_NONE);
+
+	// [server] damage multiplier for a bone on the given mesh, 1 if no modifier applies to the bone or any of its parents
+	float GetBoneDamageMultiplier(const class USkeletalMeshComponent* HitMesh, const int32 BoneIndex) const;
+
+	// [local] check if shots should be queued and sent with ServerHandleShots
+	bool ShouldBatchShots() const;
+
+	// [server] check if the client calling the per shot RPCs should be batching its shots instead, ShouldBatchShots for the caller
+	bool ServerExpectsBatchedShots() const;
+
+	// [local] add a shot to the queue, Hit is null for a miss
+	void QueueShot(const FWeaponTraceRequest& Trace, const FHitResult* Hit);
+
+	// [local] send all queued shots to the server
+	void FlushPendingShots();
+
+	// [server] fire & update ammo for a batch of shots
+	UFUNCTION(Server, Reliable, WithValidation)
+	void ServerHandleShots(const TArray<FWeaponShot>& Shots);
+
+	// [server] fire, update ammo and apply the hit for one shot from ServerHandleShots
+	void ServerProcessShot(const FWeaponShot& Shot);
+
+	// [server] count an incoming weapon RPC against the owning connection
+	void TrackWeaponRPC(const bool bBatched, const int64 PayloadBits, const int32 NumShots) const;
+
+	// [server] count a dropped shot or hit against the owning connection, Reason is logged at most once per RejectionLogInterval
+	void TrackRejection(const bool bHit, const TCHAR* Reason) const;
+
+	// [server] rewinds the hit player to ShotTime and checks the shot could have hit them
+	// FlightTime is how long a simulated bullet flew before the hit, the origin can be that far from the shooter
+	bool ServerValidateHit(class AMainCharacter* HitPlayer, const float ShotTime, const FVector& Origin, const FVector& Direction, const FName BoneName, const float FlightTime = 0.f) const;
+
+	// [local] server world time, used to timestamp shots so the server can rewind to them
+	float GetServerWorldTime() const;
+
+	// [local] server world time of the shot being fired
+	float GetShotServerTime() const;
 	
 	// [local] weapon specific fire implementation 
 	virtual void FireShot();
@@ -468,8 +850,22 @@ protected:
 	UFUNCTION(reliable, server, WithValidation)
 	void ServerHandleFiring();
 
-	// [local + server] handle weapon refire, compensating for slack time if the timer can't sample fast enough 
-	void HandleReFiring();
+	// [local + server] fire every scheduled shot that is due this frame, each at the time it was due
+	void ProcessScheduledShots();
+
+	// [server] check a client shot is no faster than TimeBetweenShots allows, using the shots timestamp
+	bool ServerCheckFireRate(const float ShotTime);
+
+	// [server] check a later pellet or bullet impact belongs to a recent accepted shot and hasn't hit already
+	// gives back the time to rewind to and how long the bullet was in flight
+	bool ServerCheckShotHit(const FWeaponShot& Shot, float& OutRewindTime, float& OutFlightTime);
+
+	// [server] claims a pellet of a recent shot from ServerHandleFiring for a hit from ServerHandleHit, false if every recent shot has used all its pellets
+	// the per shot RPCs don't carry a shot index, so the newest shot with a pellet left is used. ShotTime is clamped to the time of that shot
+	bool ServerClaimPerShotHit(float& InOutShotTime);
+
+	// [local] a simulated bullet from this weapon hit something
+	void OnBulletImpact(const struct FBulletImpact& Impact);
 
 	// [local + server] handle weapon fire 
 	void HandleFiring();
@@ -495,8 +891,8 @@ protected:
 //////////////////////////////////////////////////////////////////////////
 // Weapon usage helpers
 
-	// play weapon sounds 
-	UAudioComponent* PlayWeaponSound(USoundCue* Sound);
+	// play weapon sounds, one shot sounds are pooled so only keep the returned component if bPersistent is set
+	UAudioComponent* PlayWeaponSound(USoundCue* Sound, const bool bPersistent = false);
 
 	// play weapon animations 
 	float PlayWeaponAnimation(const FWeaponAnim& Animation);
@@ -507,12 +903,17 @@ protected:
 	// Get the aim of the camera 
 	FVector GetCameraAim() const;
 
-	// in code, not video
-	// // called in network play to do the cosmetic fx  
-	// void SimulateInstantHit(const FVector& Origin);
+	// [server] queues the tracer and impact of an accepted shot for the other clients. ImpactPoint is null for a miss
+	void ServerAddShotEvent(const FVector& Origin, const FVector& Direction, const FVector* ImpactPoint, const uint8 SurfaceType);
+
+	// plays the cosmetic fx for shot events sent by the server, skipping the ones too far from the local view to be seen
+	void SimulateShotEvents(const TArray<FShotEvent>& Events);
+
+	// called in network play to do the cosmetic fx  
+	void SimulateInstantHit(const FShotEvent& Event);
 
-	// // spawn effects for impact 
-	// void SpawnImpactEffects(const FHitResult& Impact);
+	// spawn effects for impact 
+	void SpawnImpactEffects(const FShotEvent& Event);
 
 	// here in video, down in public in final code
 	// find hit 
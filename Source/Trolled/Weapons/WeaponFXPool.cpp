@@ -0,0 +1,208 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "WeaponFXPool.h"
+#include "Trolled/Trolled.h"
+#include "Components/AudioComponent.h"
+#include "Particles/ParticleSystemComponent.h"
+#include "Sound/SoundBase.h"
+#include "Engine/World.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("FX Components Created"), STAT_WeaponFXCreated, STATGROUP_TrolledWeapon);
+DECLARE_DWORD_COUNTER_STAT(TEXT("FX Components Reused"), STAT_WeaponFXReused, STATGROUP_TrolledWeapon);
+DECLARE_DWORD_COUNTER_STAT(TEXT("FX Components Taken Over"), STAT_WeaponFXTakenOver, STATGROUP_TrolledWeapon);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("FX Components Playing"), STAT_WeaponFXPlaying, STATGROUP_TrolledWeapon);
+
+bool UWeaponFXPool::ShouldCreateSubsystem(UObject* Outer) const
+{
+	return !IsRunningDedicatedServer();
+}
+
+void UWeaponFXPool::Deinitialize()
+{
+	// emptied before destroying, destroying a playing component can finish it and call back into the pool
+	TArray<UParticleSystemComponent*> Particles = MoveTemp(FreeParticles);
+	Particles.Append(MoveTemp(ActiveParticles));
+	FreeParticles.Empty();
+	ActiveParticles.Empty();
+
+	TArray<UAudioComponent*> Sounds = MoveTemp(FreeSounds);
+	Sounds.Append(MoveTemp(ActiveSounds));
+	FreeSounds.Empty();
+	ActiveSounds.Empty();
+	StaleSoundFinishes.Empty();
+
+	for (UParticleSystemComponent* PSC : Particles)
+	{
+		if (PSC)
+		{
+			PSC->DestroyComponent();
+		}
+	}
+
+	for (UAudioComponent* AC : Sounds)
+	{
+		if (AC)
+		{
+			AC->DestroyComponent();
+		}
+	}
+
+	SET_DWORD_STAT(STAT_WeaponFXPlaying, 0);
+
+	Super::Deinitialize();
+}
+
+UParticleSystemComponent* UWeaponFXPool::SpawnEmitterAttached(UParticleSystem* Template, USceneComponent* AttachTo, const FName SocketName /*= NAME_None*/)
+{
+	if (!Template || !AttachTo)
+	{
+		return nullptr;
+	}
+
+	UParticleSystemComponent* PSC = AcquireParticleComponent();
+	PSC->SetTemplate(Template);
+	PSC->AttachToComponent(AttachTo, FAttachmentTransformRules::SnapToTargetNotIncludingScale, SocketName);
+	PSC->ActivateSystem(true);
+
+	return PSC;
+}
+
+UParticleSystemComponent* UWeaponFXPool::SpawnEmitterAtLocation(UParticleSystem* Template, const FVector& Location, const FRotator& Rotation)
+{
+	if (!Template)
+	{
+		return nullptr;
+	}
+
+	UParticleSystemComponent* PSC = AcquireParticleComponent();
+	PSC->SetTemplate(Template);
+	PSC->SetWorldLocationAndRotation(Location, Rotation);
+	PSC->ActivateSystem(true);
+
+	return PSC;
+}
+
+UAudioComponent* UWeaponFXPool::SpawnSoundAttached(USoundBase* Sound, USceneComponent* AttachTo, const FName SocketName /*= NAME_None*/)
+{
+	if (!Sound || !AttachTo)
+	{
+		return nullptr;
+	}
+
+	UAudioComponent* AC = AcquireAudioComponent();
+	AC->SetSound(Sound);
+	AC->AttachToComponent(AttachTo, FAttachmentTransformRules::SnapToTargetNotIncludingScale, SocketName);
+	AC->Play();
+
+	return AC;
+}
+
+UParticleSystemComponent* UWeaponFXPool::AcquireParticleComponent()
+{
+	UParticleSystemComponent* PSC = nullptr;
+
+	if (FreeParticles.Num() > 0)
+	{
+		PSC = FreeParticles.Pop(false);
+		INC_DWORD_STAT(STAT_WeaponFXReused);
+	}
+	else if (ActiveParticles.Num() < MaxParticleComponents)
+	{
+		// only registered once, after this it just gets a new template
+		PSC = NewObject<UParticleSystemComponent>(GetWorld());
+		PSC->bAutoActivate = false;
+		PSC->bAutoDestroy = false;
+		PSC->bAllowAnyoneToDestroyMe = true;
+		PSC->SecondsBeforeInactive = 0.f;
+		PSC->OnSystemFinished.AddDynamic(this, &UWeaponFXPool::OnParticleFinished);
+		PSC->RegisterComponentWithWorld(GetWorld());
+		INC_DWORD_STAT(STAT_WeaponFXCreated);
+	}
+	else
+	{
+		// pool is full, take over the oldest. Removed from the active list first so finishing it doesn't return it to the pool
+		PSC = ActiveParticles[0];
+		ActiveParticles.RemoveAt(0, 1, false);
+		PSC->DeactivateImmediate();
+		DEC_DWORD_STAT(STAT_WeaponFXPlaying);
+		INC_DWORD_STAT(STAT_WeaponFXTakenOver);
+	}
+
+	ActiveParticles.Add(PSC);
+	INC_DWORD_STAT(STAT_WeaponFXPlaying);
+
+	return PSC;
+}
+
+UAudioComponent* UWeaponFXPool::AcquireAudioComponent()
+{
+	UAudioComponent* AC = nullptr;
+
+	if (FreeSounds.Num() > 0)
+	{
+		AC = FreeSounds.Pop(false);
+		INC_DWORD_STAT(STAT_WeaponFXReused);
+	}
+	else if (ActiveSounds.Num() < MaxAudioComponents)
+	{
+		// only registered once, after this it just gets a new sound
+		AC = NewObject<UAudioComponent>(GetWorld());
+		AC->bAutoActivate = false;
+		AC->bAutoDestroy = false;
+		AC->OnAudioFinishedNative.AddUObject(this, &UWeaponFXPool::OnSoundFinished);
+		AC->RegisterComponentWithWorld(GetWorld());
+		INC_DWORD_STAT(STAT_WeaponFXCreated);
+	}
+	else
+	{
+		// pool is full, take over the oldest. The stop finishes on the audio thread and calls back after the component is playing
+		// its new sound, so remember to ignore that callback instead of returning a playing component to the pool
+		AC = ActiveSounds[0];
+		ActiveSounds.RemoveAt(0, 1, false);
+		if (AC->IsPlaying())
+		{
+			StaleSoundFinishes.FindOrAdd(AC)++;
+		}
+		AC->Stop();
+		DEC_DWORD_STAT(STAT_WeaponFXPlaying);
+		INC_DWORD_STAT(STAT_WeaponFXTakenOver);
+	}
+
+	ActiveSounds.Add(AC);
+	INC_DWORD_STAT(STAT_WeaponFXPlaying);
+
+	return AC;
+}
+
+void UWeaponFXPool::OnParticleFinished(UParticleSystemComponent* PSC)
+{
+	// components that were taken over are no longer in the active list
+	if (ActiveParticles.RemoveSingle(PSC) > 0)
+	{
+		PSC->DetachFromComponent(FDetachmentTransformRules::KeepWorldTransform);
+		FreeParticles.Add(PSC);
+		DEC_DWORD_STAT(STAT_WeaponFXPlaying);
+	}
+}
+
+void UWeaponFXPool::OnSoundFinished(UAudioComponent* AC)
+{
+	// the old playback of a component that was taken over
+	if (int32* StaleFinishes = StaleSoundFinishes.Find(AC))
+	{
+		if (--(*StaleFinishes) <= 0)
+		{
+			StaleSoundFinishes.Remove(AC);
+		}
+		return;
+	}
+
+	// components that were taken over are no longer in the active list
+	if (ActiveSounds.RemoveSingle(AC) > 0)
+	{
+		AC->DetachFromComponent(FDetachmentTransformRules::KeepWorldTransform);
+		FreeSounds.Add(AC);
+		DEC_DWORD_STAT(STAT_WeaponFXPlaying);
+	}
+}
@@ -0,0 +1,81 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "WeaponFXPool.generated.h"
+
+class UParticleSystem;
+class UParticleSystemComponent;
+class UAudioComponent;
+class USoundBase;
+
+/**
+ * Per world pool of particle and audio components for one shot weapon cosmetics like muzzle flashes, impacts and fire sounds
+ * Components are registered once and handed back out when they finish, so firing doesn't create or register components
+ * Once a pool is at its cap the oldest playing component is taken over, a cut off muzzle flash is better than a hitch
+ */
+UCLASS(Config = Game)
+class TROLLED_API UWeaponFXPool : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	// dedicated servers never play cosmetics
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+
+	// destroys every pooled component
+	virtual void Deinitialize() override;
+
+	// plays a one shot particle system attached to a component, the returned component goes back to the pool when it finishes so don't hold on to it
+	UParticleSystemComponent* SpawnEmitterAttached(UParticleSystem* Template, USceneComponent* AttachTo, const FName SocketName = NAME_None);
+
+	// plays a one shot particle system in the world, used for impacts
+	UParticleSystemComponent* SpawnEmitterAtLocation(UParticleSystem* Template, const FVector& Location, const FRotator& Rotation);
+
+	// plays a one shot sound attached to a component, the returned component goes back to the pool when it finishes so don't hold on to it
+	UAudioComponent* SpawnSoundAttached(USoundBase* Sound, USceneComponent* AttachTo, const FName SocketName = NAME_None);
+
+	// max particle components in the pool, free and playing
+	UPROPERTY(Config)
+	int32 MaxParticleComponents = 64;
+
+	// max audio components in the pool, free and playing
+	UPROPERTY(Config)
+	int32 MaxAudioComponents = 32;
+
+private:
+
+	// gets a free particle component, creating one or taking over the oldest if there are none
+	UParticleSystemComponent* AcquireParticleComponent();
+
+	// gets a free audio component, creating one or taking over the oldest if there are none
+	UAudioComponent* AcquireAudioComponent();
+
+	// returns a finished particle component to the pool
+	UFUNCTION()
+	void OnParticleFinished(UParticleSystemComponent* PSC);
+
+	// returns a finished audio component to the pool
+	void OnSoundFinished(UAudioComponent* AC);
+
+	// components ready to be used
+	UPROPERTY(Transient)
+	TArray<UParticleSystemComponent*> FreeParticles;
+
+	UPROPERTY(Transient)
+	TArray<UAudioComponent*> FreeSounds;
+
+	// playing components, oldest first
+	UPROPERTY(Transient)
+	TArray<UParticleSystemComponent*> ActiveParticles;
+
+	UPROPERTY(Transient)
+	TArray<UAudioComponent*> ActiveSounds;
+
+	// finish callbacks still to come from playbacks that were stopped when their component was taken over
+	// stopping a sound is async, so the callback can arrive after the component is playing again and has to be ignored
+	TMap<UAudioComponent*, int32> StaleSoundFinishes;
+};
@@ -0,0 +1,380 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "WeaponLoadTestSubsystem.h"
+#include "Trolled/Trolled.h"
+#include "Trolled/MainCharacter.h"
+#include "Trolled/Weapons/Weapon.h"
+#include "Trolled/Items/WeaponItem.h"
+#include "Trolled/Items/AmmoItem.h"
+#include "Trolled/Components/InventoryComponent.h"
+#include "Trolled/Components/HitboxHistoryComponent.h"
+#include "GameFramework/GameModeBase.h"
+#include "Engine/World.h"
+#include "Engine/NetDriver.h"
+#include "Engine/NetConnection.h"
+#include "HAL/IConsoleManager.h"
+
+#if !UE_BUILD_SHIPPING
+static FAutoConsoleCommandWithWorldAndArgs WeaponLoadTestCommand(
+	TEXT("Trolled.WeaponLoadTest"),
+	TEXT("Spawns bots that fire continuously and captures a csv of the weapon fire path. Server only. Usage: Trolled.WeaponLoadTest [NumBots=32] [Duration=60], NumBots 0 stops the test"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic([](const TArray<FString>& Args, UWorld* World)
+	{
+		UWeaponLoadTestSubsystem* LoadTest = World ? World->GetSubsystem<UWeaponLoadTestSubsystem>() : nullptr;
+		if (!LoadTest || World->GetNetMode() == NM_Client)
+		{
+			return;
+		}
+
+		const int32 NumBots = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 32;
+		const float Duration = Args.Num() > 1 ? FCString::Atof(*Args[1]) : 60.f;
+
+		if (NumBots > 0)
+		{
+			LoadTest->StartLoadTest(NumBots, FMath::Max(Duration, 0.f));
+		}
+		else
+		{
+			LoadTest->StopLoadTest();
+		}
+	}));
+
+// e.g. -nullrhi -ExecCmds="Trolled.HitValidationBenchmark 10000 64 128"
+static FAutoConsoleCommandWithWorldAndArgs HitValidationBenchmarkCommand(
+	TEXT("Trolled.HitValidationBenchmark"),
+	TEXT("Fills the hitbox history of bots and times the servers hit validation per shot. Stops any load test. Server only. Usage: Trolled.HitValidationBenchmark [NumShots=10000] [NumPlayers...=64 128]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic([](const TArray<FString>& Args, UWorld* World)
+	{
+		UWeaponLoadTestSubsystem* LoadTest = World ? World->GetSubsystem<UWeaponLoadTestSubsystem>() : nullptr;
+		if (!LoadTest || World->GetNetMode() == NM_Client)
+		{
+			return;
+		}
+
+		const int32 NumShots = FMath::Max(Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 10000, 1);
+
+		// each player count is run with a fresh set of bots
+		TArray<int32> PlayerCounts;
+		for (int32 i = 1; i < Args.Num(); ++i)
+		{
+			PlayerCounts.Add(FMath::Max(FCString::Atoi(*Args[i]), 2));
+		}
+
+		if (PlayerCounts.Num() == 0)
+		{
+			PlayerCounts = { 64, 128 };
+		}
+
+		for (const int32 NumPlayers : PlayerCounts)
+		{
+			LoadTest->RunHitValidationBenchmark(NumPlayers, NumShots);
+		}
+	}));
+#endif
+
+void UWeaponLoadTestSubsystem::Deinitialize()
+{
+	// the world is going away with the bots in it, just make sure the capture is written
+	if (bRunning)
+	{
+#if CSV_PROFILER
+		FCsvProfiler::Get()->EndCapture();
+#endif
+		bRunning = false;
+		Bots.Reset();
+	}
+
+	Super::Deinitialize();
+}
+
+void UWeaponLoadTestSubsystem::Tick(float DeltaTime)
+{
+	++NumFrames;
+	TotalFrameTime += DeltaTime;
+	MaxFrameTime = FMath::Max(MaxFrameTime, DeltaTime);
+
+	if (EndTime > 0.f && GetWorld()->GetTimeSeconds() >= EndTime)
+	{
+		StopLoadTest();
+		return;
+	}
+
+	int32 NumFiring = 0;
+	for (AMainCharacter* Bot : Bots)
+	{
+		if (IsValid(Bot))
+		{
+			KeepBotFiring(Bot);
+			NumFiring += Bot->GetEquippedWeapon() && Bot->GetEquippedWeapon()->GetCurrentState() == EWeaponState::Firing;
+		}
+	}
+
+	CSV_CUSTOM_STAT(TrolledWeapon, LoadTestBotsFiring, NumFiring, ECsvCustomStatOp::Set);
+
+	RecordConnectionStats();
+}
+
+bool UWeaponLoadTestSubsystem::IsTickable() const
+{
+	// the class default object is registered as a tickable too
+	return !IsTemplate() && bRunning;
+}
+
+TStatId UWeaponLoadTestSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UWeaponLoadTestSubsystem, STATGROUP_Tickables);
+}
+
+void UWeaponLoadTestSubsystem::StartLoadTest(const int32 NumBots, const float Duration)
+{
+	StopLoadTest();
+
+	if (!SpawnBots(NumBots))
+	{
+		return;
+	}
+
+	UWorld* World = GetWorld();
+
+	bRunning = true;
+	StartTime = World->GetTimeSeconds();
+	EndTime = Duration > 0.f ? StartTime + Duration : 0.f;
+	NumFrames = 0;
+	TotalFrameTime = 0.f;
+	MaxFrameTime = 0.f;
+
+#if CSV_PROFILER
+	FCsvProfiler::Get()->BeginCapture();
+#endif
+
+	UE_LOG(LogTemp, Log, TEXT("Weapon load test started with %d bots"), Bots.Num());
+}
+
+void UWeaponLoadTestSubsystem::StopLoadTest()
+{
+	if (!bRunning)
+	{
+		return;
+	}
+
+	bRunning = false;
+
+#if CSV_PROFILER
+	FCsvProfiler::Get()->EndCapture();
+#endif
+
+	DestroyBots();
+
+	const float AvgFrameTime = NumFrames > 0 ? TotalFrameTime / NumFrames : 0.f;
+	UE_LOG(LogTemp, Log, TEXT("Weapon load test finished after %.1fs, %d frames, avg frame %.2fms, max frame %.2fms"),
+		GetWorld()->GetTimeSeconds() - StartTime, NumFrames, AvgFrameTime * 1000.f, MaxFrameTime * 1000.f);
+}
+
+bool UWeaponLoadTestSubsystem::SpawnBots(const int32 NumBots)
+{
+	UWorld* World = GetWorld();
+	AGameModeBase* GameMode = World->GetAuthGameMode();
+	UClass* WeaponItemClass = LoadTestWeaponItem.TryLoadClass<UWeaponItem>();
+
+	// bots use the same character as players
+	UClass* PawnClass = GameMode ? GameMode->DefaultPawnClass.Get() : nullptr;
+	if (!PawnClass || !PawnClass->IsChildOf(AMainCharacter::StaticClass()) || !WeaponItemClass)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Weapon load test needs a MainCharacter default pawn and LoadTestWeaponItem set in the game config"));
+		return false;
+	}
+
+	// square grid around the first player start, each bot looking down at the ground in front of it
+	const AActor* PlayerStart = GameMode->FindPlayerStart(nullptr);
+	const FVector Origin = PlayerStart ? PlayerStart->GetActorLocation() : FVector::ZeroVector;
+	const FRotator AimRotation(BotAimPitch, PlayerStart ? PlayerStart->GetActorRotation().Yaw : 0.f, 0.f);
+	const int32 GridSize = FMath::CeilToInt(FMath::Sqrt((float)NumBots));
+
+	Bots.Reserve(NumBots);
+	for (int32 i = 0; i < NumBots; ++i)
+	{
+		const FVector Location = Origin + FVector((i % GridSize) * BotSpacing, (i / GridSize) * BotSpacing, 0.f);
+		if (AMainCharacter* Bot = SpawnBot(PawnClass, WeaponItemClass, Location, AimRotation))
+		{
+			Bots.Add(Bot);
+		}
+	}
+
+	return true;
+}
+
+void UWeaponLoadTestSubsystem::DestroyBots()
+{
+	for (AMainCharacter* Bot : Bots)
+	{
+		if (IsValid(Bot))
+		{
+			if (AController* Controller = Bot->GetController())
+			{
+				Controller->Destroy();
+			}
+			Bot->Destroy();
+		}
+	}
+	Bots.Reset();
+}
+
+void UWeaponLoadTestSubsystem::RunHitValidationBenchmark(const int32 NumPlayers, const int32 NumShots)
+{
+	StopLoadTest();
+
+	if (!SpawnBots(NumPlayers))
+	{
+		return;
+	}
+
+	// bots without a weapon or history can't take part
+	TArray<AMainCharacter*> Players;
+	for (AMainCharacter* Bot : Bots)
+	{
+		if (IsValid(Bot) && Bot->GetEquippedWeapon() && Bot->HitboxHistory && Bot->HitboxHistory->HitboxBones.Num() > 0)
+		{
+			Bot->HitboxHistory->FillHistory();
+			Players.Add(Bot);
+		}
+	}
+
+	if (Players.Num() < 2)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Hit validation benchmark needs at least 2 bots with a weapon and a hitbox history"));
+		DestroyBots();
+		return;
+	}
+
+	// build every shot first so only the validation is timed. Each shot is aimed at a random hitbox bone of a random other player,
+	// fired at a random time in the rewind window
+	struct FBenchmarkShot
+	{
+		AWeapon* Weapon;
+		AMainCharacter* Target;
+		FVector Origin;
+		FVector Direction;
+		FName BoneName;
+		float ShotTime;
+	};
+
+	const float Now = GetWorld()->GetTimeSeconds();
+	FRandomStream Stream(NumPlayers);
+	TArray<FBenchmarkShot> Shots;
+	Shots.Reserve(NumShots);
+	for (int32 i = 0; i < NumShots; ++i)
+	{
+		AMainCharacter* Shooter = Players[i % Players.Num()];
+		AMainCharacter* Target = Players[(i + 1 + Stream.RandHelper(Players.Num() - 1)) % Players.Num()];
+		const TArray<FHitboxBone>& HitboxBones = Target->HitboxHistory->HitboxBones;
+
+		FBenchmarkShot& Shot = Shots.AddDefaulted_GetRef();
+		Shot.Weapon = Shooter->GetEquippedWeapon();
+		Shot.Target = Target;
+		Shot.Origin = Shooter->GetPawnViewLocation();
+		Shot.BoneName = HitboxBones[Stream.RandHelper(HitboxBones.Num())].BoneName;
+		Shot.Direction = (Target->GetMesh()->GetBoneLocation(Shot.BoneName) - Shot.Origin).GetSafeNormal();
+		Shot.ShotTime = Now - Stream.FRand() * Target->HitboxHistory->MaxRewindTime;
+	}
+
+	int32 NumAccepted = 0;
+	const double StartSeconds = FPlatformTime::Seconds();
+	for (const FBenchmarkShot& Shot : Shots)
+	{
+		NumAccepted += Shot.Weapon->ServerValidateHit(Shot.Target, Shot.ShotTime, Shot.Origin, Shot.Direction, Shot.BoneName) ? 1 : 0;
+	}
+	const double ElapsedSeconds = FPlatformTime::Seconds() - StartSeconds;
+
+	UE_LOG(LogTemp, Log, TEXT("Hit validation benchmark with %d players: %d shots in %.2fms, %.3fus per shot, %d accepted"),
+		Players.Num(), Shots.Num(), ElapsedSeconds * 1000.0, ElapsedSeconds * 1000000.0 / Shots.Num(), NumAccepted);
+
+	DestroyBots();
+}
+
+AMainCharacter* UWeaponLoadTestSubsystem::SpawnBot(UClass* PawnClass, UClass* WeaponItemClass, const FVector& Location, const FRotator& Rotation)
+{
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButAlwaysSpawn;
+
+	AMainCharacter* Bot = GetWorld()->SpawnActor<AMainCharacter>(PawnClass, Location, FRotator(0.f, Rotation.Yaw, 0.f), SpawnParams);
+	if (!Bot)
+	{
+		return nullptr;
+	}
+
+	// the default AI controller, the weapon aims from the pawns eyes along the control rotation
+	Bot->SpawnDefaultController();
+	if (AController* Controller = Bot->GetController())
+	{
+		Controller->SetControlRotation(Rotation);
+	}
+
+	// equip the weapon the same way a player would
+	if (Bot->PlayerInventory)
+	{
+		Bot->PlayerInventory->TryAddItemFromClass(WeaponItemClass, 1);
+		if (UBaseItem* WeaponItem = Bot->PlayerInventory->FindItemByClass(WeaponItemClass))
+		{
+			Bot->UseItem(WeaponItem);
+		}
+	}
+
+	return Bot;
+}
+
+void UWeaponLoadTestSubsystem::KeepBotFiring(AMainCharacter* Bot)
+{
+	AWeapon* Weapon = Bot->GetEquippedWeapon();
+	if (!Weapon || !Bot->PlayerInventory)
+	{
+		return;
+	}
+
+	// keep a couple of mags in the inventory so reloads are part of the test but the bots never run dry
+	const int32 AmmoPerMag = Weapon->GetAmmoPerMag();
+	if (Weapon->WeaponConfig.AmmoClass && Weapon->GetCurrentAmmo() < AmmoPerMag)
+	{
+		Bot->PlayerInventory->TryAddItemFromClass(Weapon->WeaponConfig.AmmoClass, AmmoPerMag * 2);
+	}
+
+	// semi automatic weapons and finished reloads go back to idle, pull the trigger again
+	if (Weapon->GetCurrentState() == EWeaponState::Idle)
+	{
+		Weapon->StopFire();
+		Weapon->StartFire();
+	}
+}
+
+void UWeaponLoadTestSubsystem::RecordConnectionStats()
+{
+	UNetDriver* NetDriver = GetWorld()->GetNetDriver();
+	if (!NetDriver)
+	{
+		return;
+	}
+
+	// the byte rates are updated by the connections once a second
+	int32 TotalInBytes = 0;
+	int32 TotalOutBytes = 0;
+	int32 MaxInBytes = 0;
+	for (const UNetConnection* Connection : NetDriver->ClientConnections)
+	{
+		if (Connection)
+		{
+			TotalInBytes += Connection->InBytesPerSecond;
+			TotalOutBytes += Connection->OutBytesPerSecond;
+			MaxInBytes = FMath::Max(MaxInBytes, Connection->InBytesPerSecond);
+		}
+	}
+
+	const int32 NumConnections = NetDriver->ClientConnections.Num();
+	CSV_CUSTOM_STAT(TrolledWeapon, Connections, NumConnections, ECsvCustomStatOp::Set);
+
+	if (NumConnections > 0)
+	{
+		CSV_CUSTOM_STAT(TrolledWeapon, AvgConnectionInBytesPerSec, TotalInBytes / NumConnections, ECsvCustomStatOp::Set);
+		CSV_CUSTOM_STAT(TrolledWeapon, AvgConnectionOutBytesPerSec, TotalOutBytes / NumConnections, ECsvCustomStatOp::Set);
+		CSV_CUSTOM_STAT(TrolledWeapon, MaxConnectionInBytesPerSec, MaxInBytes, ECsvCustomStatOp::Set);
+	}
+}
@@ -0,0 +1,93 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "WeaponLoadTestSubsystem.generated.h"
+
+class AMainCharacter;
+
+/**
+ * Server load test for the weapon fire path. Spawns bot controlled characters with a weapon equipped and keeps them firing,
+ * while a csv capture records the frame time, the TrolledWeapon fire path timings, weapon RPCs and bytes per connection
+ * Run headless on a dedicated server, e.g. TrolledServer <Map> -log -nullrhi -ExecCmds="Trolled.WeaponLoadTest 32 60"
+ * Connect -nullrhi clients that fire to get RPC and connection numbers, bots fire on the server so they don't send RPCs
+ * The csv is written to Saved/Profiling/CSV when the test ends
+ */
+UCLASS(Config = Game)
+class TROLLED_API UWeaponLoadTestSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+
+	// removes any bots left over
+	virtual void Deinitialize() override;
+
+	// FTickableGameObject, keeps the bots firing and samples the connections
+	virtual void Tick(float DeltaTime) override;
+	virtual bool IsTickable() const override;
+	virtual TStatId GetStatId() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override { return GetWorld(); }
+
+	/** Spawns the bots and starts the csv capture, stopping any test already running
+	 * @param NumBots how many bots to spawn, they are placed in a grid around the first player start
+	 * @param Duration seconds before the test stops by itself, 0 to run until StopLoadTest */
+	void StartLoadTest(const int32 NumBots, const float Duration);
+
+	// removes the bots, ends the csv capture and logs a summary
+	void StopLoadTest();
+
+	/** Times the servers hit validation with a full hitbox history on every player. Stops any load test that is running
+	 * Spawns the same bots as the load test, then validates shots between random pairs of them and logs the cost per shot
+	 * @param NumPlayers how many bots to spawn
+	 * @param NumShots how many hits to validate */
+	void RunHitValidationBenchmark(const int32 NumPlayers, const int32 NumShots);
+
+	FORCEINLINE bool IsRunning() const { return bRunning; }
+
+	// weapon item given to each bot, needs to use an automatic weapon to fire continuously
+	UPROPERTY(Config)
+	FSoftClassPath LoadTestWeaponItem;
+
+	// distance between bots in the spawn grid
+	UPROPERTY(Config)
+	float BotSpacing = 250.f;
+
+	// pitch the bots aim at, down at the ground so every shot is a hit without the bots killing each other
+	UPROPERTY(Config)
+	float BotAimPitch = -30.f;
+
+private:
+
+	// spawns a bot at a location and equips its weapon
+	AMainCharacter* SpawnBot(UClass* PawnClass, UClass* WeaponItemClass, const FVector& Location, const FRotator& Rotation);
+
+	// spawns NumBots bots in a grid around the first player start, false if the game config is missing the pawn or weapon
+	bool SpawnBots(const int32 NumBots);
+
+	// destroys every bot and its controller
+	void DestroyBots();
+
+	// gives a bot more ammo and starts firing again once it has stopped
+	void KeepBotFiring(AMainCharacter* Bot);
+
+	// writes the per connection byte rates to the csv
+	void RecordConnectionStats();
+
+	UPROPERTY(Transient)
+	TArray<AMainCharacter*> Bots;
+
+	bool bRunning = false;
+
+	// world time the test started and the time it stops, 0 to run until stopped
+	float StartTime = 0.f;
+	float EndTime = 0.f;
+
+	// frame times while running, for the summary
+	int32 NumFrames = 0;
+	float TotalFrameTime = 0.f;
+	float MaxFrameTime = 0.f;
+};
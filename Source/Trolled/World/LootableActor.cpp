@@ -54,6 +54,9 @@ void ALootableActor::BeginPlay()
 		// select a random number between the range defined in the constructor
 		int32 Rolls = FMath::RandRange(LootRolls.GetMin(), LootRolls.GetMax());
 
+		// everything rolled is added to the inventory together once the rolls are done
+		TArray<FItemInstance> RolledItems;
+
 		// loop that many times
 		for (int32 i = 0; i < Rolls; ++i)
 		{
@@ -84,15 +87,15 @@ void ALootableActor::BeginPlay()
 					// if the item has a valid class
 					if (ItemClass)
 					{
-						// get the default quantity of the item
-						const int32 Quantity = Cast<UBaseItem>(ItemClass->GetDefaultObject())->GetQuantity();
-						
-						// try to add the item
-						Inventory->TryAddItemFromClass(ItemClass, Quantity);
+						// use the default quantity of the item
+						RolledItems.Add(FItemInstance(ItemClass, GetDefault<UBaseItem>(ItemClass)->GetQuantity()));
 					}
 				}
 			}
 		}
+
+		// try to add the items
+		Inventory->TryAddItems(RolledItems);
 	}
 	
 }
@@ -9,7 +9,6 @@
 #include "Components/StaticMeshComponent.h"
 #include "Trolled/Components/InteractionComponent.h"
 #include "Trolled/Components/InventoryComponent.h"
-#include "Engine/ActorChannel.h"
 
 // Sets default values
 APickupBase::APickupBase()
@@ -38,44 +37,29 @@ APickupBase::APickupBase()
 	SetReplicates(true);
 }
 
-// create the pickups, set qty, rep item and mark dirty in the event a player drops an item back into the world
+// create the pickups and set qty, also used in the event a player drops an item back into the world
 void APickupBase::InitializePickup(const TSubclassOf<class UBaseItem> ItemClass, const int32 Quantity) 
 {
 	if (HasAuthority() && ItemClass && Quantity > 0)
 	{
-		Item = NewObject<UBaseItem>(this, ItemClass);
-		Item->SetQuantity(Quantity);
-
+		Item = FItemInstance(ItemClass, Quantity);
 		OnRep_Item();
-		Item->MarkDirtyForReplication();
 	}
 }
 
 void APickupBase::OnRep_Item() 
 {
-	if (Item)
+	if (const UBaseItem* Definition = Item.GetDefinition())
 	{
 		// bind the static mesh and display name to the pickup object
-		PickupMesh->SetStaticMesh(Item->PickupMesh);
-		InteractionComponent->InteractableNameText = Item->ItemDisplayName;
-
-		// binds clients to the delegate for UI refresh when quantities change
-		Item->OnItemModified.AddDynamic(this, &APickupBase::OnItemModified);
+		PickupMesh->SetStaticMesh(Definition->PickupMesh);
+		InteractionComponent->InteractableNameText = Definition->ItemDisplayName;
 	}
 
 	// if properties are changed, refresh widget
 	InteractionComponent->RefreshWidget();
 }
 
-void APickupBase::OnItemModified() 
-{
-	if (InteractionComponent)
-	{
-		// if properties are changed, refresh widget
-		InteractionComponent->RefreshWidget();
-	}
-}
-
 // Called when the game starts or when spawned
 void APickupBase::BeginPlay()
 {
@@ -88,17 +72,14 @@ void APickupBase::BeginPlay()
 		InitializePickup(ItemTemplate->GetClass(), ItemTemplate->GetQuantity());
 	}
 
+	// the template has been copied into Item, nothing else reads it during play
+	ItemTemplate = nullptr;
+
 	// if not at startup, indicating a player dropped an item, align pickup with the ground
 	if (!bNetStartup)
 	{
 		AlignWithGround();
 	}
-
-	// if item, mark dirty for rep so players know about the item
-	if (Item)
-	{
-		Item->MarkDirtyForReplication();
-	}
 }
 
 void APickupBase::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const 
@@ -109,21 +90,6 @@ void APickupBase::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifet
     DOREPLIFETIME(APickupBase, Item);
 }
 
-bool APickupBase::ReplicateSubobjects(class UActorChannel *Channel, class FOutBunch *Bunch, FReplicationFlags *RepFlags) 
-{
-	// true when a modification has been made to actor channel
-	bool bWroteSomething = Super::ReplicateSubobjects(Channel, Bunch, RepFlags);
-
-	// replicate if item marked as needs to replicate
-	if (Item && Channel->KeyNeedsToReplicate(Item->GetUniqueID(), Item->RepKey))
-	{
-		bWroteSomething |= Channel->ReplicateSubobject(Item, *Bunch, *RepFlags);
-	}
-
-	// returns a bool
-	return bWroteSomething;
-}
-
 #if WITH_EDITOR
 	void APickupBase::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) 
 {
@@ -154,21 +120,22 @@ void APickupBase::OnTakePickup(class AMainCharacter* Taker)
 	}
 
 	// check that is server, item wasnt taken from a player that was killed, valid item
-	if(HasAuthority() && !IsPendingKillPending() && Item)
+	if(HasAuthority() && !IsPendingKillPending() && Item.IsValid())
 	{
 		// if players inventory is valid
 		if (UInventoryComponent* PlayerInventory = Taker->PlayerInventory)
 		{
 			// check what the add result was
-			const FItemAddResult AddResult = PlayerInventory->TryAddItem(Item);
+			const FItemAddResult AddResult = PlayerInventory->TryAddItemInstance(Item);
 
 			// if actual amount taken was less than total quantity, set quantity for pickup to new value
-			if (AddResult.ActualAmountGiven < Item->GetQuantity())
+			if (AddResult.ActualAmountGiven < Item.Quantity)
 			{
-				Item->SetQuantity(Item->GetQuantity() - AddResult.ActualAmountGiven);
+				Item.Quantity -= AddResult.ActualAmountGiven;
+				OnRep_Item();
 			}
 			// if it was more than or equal to total pickup quantity, destroy the pickup from the world
-			else if (AddResult.ActualAmountGiven >= Item->GetQuantity())
+			else if (AddResult.ActualAmountGiven >= Item.Quantity)
 			{
 				Destroy();
 			}
@@ -4,6 +4,7 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
+#include "Trolled/Items/BaseItem.h"
 #include "PickupBase.generated.h"
 
 UCLASS()
@@ -23,29 +24,30 @@ public:
 	void AlignWithGround();
 
 	// Instanced template that holds the actual items info
+	// only read at startup, the pickup lets go of it once Item is set so placed pickups dont keep an item object alive
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Instanced)
 	class UBaseItem* ItemTemplate;
 
+	// the class and quantity of the item, name and mesh come from the items definition
+	UFUNCTION(BlueprintPure, Category = "Pickup")
+	FORCEINLINE FItemInstance GetItem() const { return Item; };
+
 protected:
 
 	// The item that is added to the inventory when pickup is taken
-	UPROPERTY(BlueprintReadWrite, VisibleAnywhere, ReplicatedUsing = OnRep_Item)
-	class UBaseItem* Item;
+	// replicated as a plain struct, there is no item object on the pickup
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, ReplicatedUsing = OnRep_Item)
+	FItemInstance Item;
 
-	// replication function
+	// replication function, also refreshes the widget when the quantity changes
 	UFUNCTION()
 	void OnRep_Item();
 
-	// binds to the UI for updates when an item is modified
-	UFUNCTION()
-	void OnItemModified();
-
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 
 	// pickup items are replicated by the server to all players so they know where/how much of an item exists in the world
 	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
-	virtual bool ReplicateSubobjects(class UActorChannel *Channel, class FOutBunch *Bunch, FReplicationFlags *RepFlags) override;
 
 // allows changing items while the game is in the editor, when published the ability to modify items is removed
 #if WITH_EDITOR